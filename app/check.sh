@@ -0,0 +1,181 @@
+#!/bin/bash
+#===========================================
+#  Authors:     Ghiles Maloum - Lucas Benesby
+#  Created:     19/10/2026
+#  Modified:    --/--/----
+#===========================================
+# Round trips synthetic images through bin/codec and checks the sizes past
+# 2^32 pixels, up to a 4 GiB decoded file. Run from app/ once the codec is built: make check
+
+CODEC=./bin/codec
+CC=${CC:-cc}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP" QTC/check_* PGM/check_*' EXIT
+mkdir -p QTC PGM
+status=0
+
+fail() {
+  echo "FAIL: $1"
+  status=1
+}
+
+# writes a P5 image: width, height, then a python expression of x and y
+pgm() {
+  python3 - "$1" "$2" "$3" "$4" <<'EOF'
+import sys
+w, h = int(sys.argv[2]), int(sys.argv[3])
+f = eval('lambda x, y: (' + sys.argv[4] + ') % 256')
+with open(sys.argv[1], 'wb') as out:
+    out.write(b'P5\n%d %d\n255\n' % (w, h))
+    for y in range(h):
+        out.write(bytes(f(x, y) for x in range(w)))
+EOF
+}
+
+# the pixels of a P5 file written by the codec, without its header
+pixels() {
+  python3 -c "import sys; d = open(sys.argv[1], 'rb').read(); \
+sys.stdout.buffer.write(d[-$2:])" "$1"
+}
+
+# lossless round trip of a 4096x4096 gradient
+pgm "$TMP/grad.pgm" 4096 4096 "(x >> 4) + 3 * (y >> 5) + (x * y) % 3"
+if $CODEC -c -l -i "$TMP/grad.pgm" -o check_grad >/dev/null &&
+    $CODEC -u -i QTC/check_grad.qtc -o check_grad >/dev/null; then
+  cmp -s <(pixels "$TMP/grad.pgm" $((4096 * 4096))) \
+         <(pixels PGM/check_grad.pgm $((4096 * 4096))) ||
+    fail "lossless round trip of 4096x4096"
+else
+  fail "encoding or decoding 4096x4096"
+fi
+
+# checkShape: only power of two squares are encoded
+pgm "$TMP/rect.pgm" 64 32 "x + y"
+pgm "$TMP/odd.pgm" 48 48 "x + y"
+$CODEC -c -l -i "$TMP/rect.pgm" -o check_rect 2>/dev/null &&
+  fail "64x32 image accepted"
+$CODEC -c -l -i "$TMP/odd.pgm" -o check_odd 2>/dev/null &&
+  fail "48x48 image accepted"
+
+# 2^32 pixels: a tile of 4 uniform quadrants (10 20 / 30 40) keeps the same
+# bitstream with a taller tree, only its header is grown to 65536x65536.
+# The statistics are read from the tree, so no pixmap is allocated.
+pgm "$TMP/quad.pgm" 16 16 "10 + 10 * (x >= 8) + 20 * (y >= 8)"
+$CODEC -c -l -i "$TMP/quad.pgm" -o check_quad >/dev/null ||
+  fail "encoding 16x16"
+python3 - QTC/check_quad.qtc QTC/check_huge.qtc <<'EOF'
+import struct, sys
+d = bytearray(open(sys.argv[1], 'rb').read())
+d[6] = 16
+struct.pack_into('<II', d, 12, 1 << 16, 1 << 16)
+open(sys.argv[2], 'wb').write(d)
+EOF
+$CODEC --stats -i QTC/check_huge.qtc >"$TMP/stats.txt" ||
+  fail "statistics of 65536x65536"
+grep -q "pixels 4294967296$" "$TMP/stats.txt" ||
+  fail "pixel count of 65536x65536"
+grep -q "^40     1073741824$" "$TMP/stats.txt" ||
+  fail "histogram of 65536x65536"
+$CODEC --stats --region 0,0,49152,32768 -i QTC/check_huge.qtc |
+  grep -q "mean 13.333$" || fail "region mean of 65536x65536"
+
+# 65536x65536 round trip in a few hundred MB: the tree of check_huge is
+# written again by saveDecodeTree, from its stored nodes only, then decoded
+# by the codec band by band into a 4 GiB file mapped in memory.
+cat >"$TMP/huge.c" <<'EOF'
+#include "qtc.h"
+
+int main(int argc, char **argv) {
+  SparseQuadTree *sqt = argc == 3 ? loadDecodeTree(argv[1], 0) : NULL;
+  int status = sqt == NULL || saveDecodeTree(sqt, argv[2], 0) == -1;
+  freeDecodeTree(sqt);
+  return status;
+}
+EOF
+if $CC $CFLAGS -o "$TMP/huge" "$TMP/huge.c" $LFLAGS; then
+  # the peak resident memory of both steps is capped at 256 MB
+  if python3 - "$TMP/huge" "$CODEC" <<'EOF'; then
+import resource, subprocess, sys
+subprocess.run([sys.argv[1], 'QTC/check_huge.qtc', 'QTC/check_copy.qtc'],
+               check=True)
+subprocess.run([sys.argv[2], '-u', '-i', 'QTC/check_copy.qtc', '-o',
+                'check_huge'], check=True, stdout=subprocess.DEVNULL)
+peak = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+assert peak < 256 << 10, 'peak of %d kB' % peak
+EOF
+    cmp -s QTC/check_huge.qtc QTC/check_copy.qtc ||
+      fail "encoding of 65536x65536"
+    python3 - PGM/check_huge.pgm <<'EOF' || fail "decoding of 65536x65536"
+import os, sys
+w = 1 << 16
+f = open(sys.argv[1], 'rb')
+start = os.path.getsize(sys.argv[1]) - w * w
+assert start > 0 and f.read(start).endswith(b'%d %d\n255\n' % (w, w))
+for x in (0, w // 2 - 1, w // 2, w - 1):
+    for y in (0, w // 2 - 1, w // 2, w - 1):
+        f.seek(start + y * w + x)
+        assert f.read(1)[0] == 10 + 10 * (x >= w // 2) + 20 * (y >= w // 2)
+EOF
+  else
+    fail "encoding or decoding 65536x65536 in 256 MB"
+  fi
+  rm -f PGM/check_huge.pgm
+else
+  fail "building the 65536x65536 test"
+fi
+
+# decodeIntoTree reads the tiles into a tree kept by the caller: once it has
+# held each tile, decoding them again allocates nothing. malloc, calloc and
+# realloc are counted by an interposer in the test program.
+cat >"$TMP/alloc.c" <<'EOF'
+#include "qtc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+static size_t count;
+void *malloc(size_t size) {
+  count++;
+  return __libc_malloc(size);
+}
+void *calloc(size_t n, size_t size) {
+  count++;
+  return __libc_calloc(n, size);
+}
+void *realloc(void *ptr, size_t size) {
+  count++;
+  return __libc_realloc(ptr, size);
+}
+
+int main(int argc, char **argv) {
+  size_t width = 4096, sizes[2];
+  unsigned char *tiles[2] = {loadFile(argv[1], &sizes[0]),
+                             loadFile(argv[2], &sizes[1])};
+  unsigned char *canvas = malloc(width * width);
+  SparseQuadTree *sqt = createDecodeTree();
+  if (argc != 3 || tiles[0] == NULL || tiles[1] == NULL || canvas == NULL ||
+      sqt == NULL)
+    return 1;
+  // the first round grows the levels, the second one is counted
+  for (int i = 0; i < 4; i++) {
+    if (i == 2)
+      count = 0;
+    if (decodeIntoTree(tiles[i % 2], sizes[i % 2], sqt, canvas, width, width,
+                       width, 0, 0, 0) == -1)
+      return 1;
+  }
+  printf("%zu\n", count);
+  return 0;
+}
+EOF
+if $CC $CFLAGS -o "$TMP/alloc" "$TMP/alloc.c" $LFLAGS; then
+  [ "$("$TMP/alloc" QTC/check_grad.qtc QTC/check_quad.qtc)" = 0 ] ||
+    fail "allocations when decoding into a reused tree"
+else
+  fail "building the allocation test"
+fi
+
+[ $status = 0 ] && echo "CHECK OK"
+exit $status
@@ -9,6 +9,7 @@
 
 #include "verbose.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -30,6 +31,146 @@ void error_arg(char arg);
 int parse_ab(int flag_a, char* alpha_str, double *alpha, 
              int flag_b, char* beta_str, double *beta, int flag_c, int verbose);
 
+/// @brief check the lossless option
+/// @param flag_l if option lossless is specified
+/// @param flag_a if option alpha is specified
+/// @param flag_b if option beta is specified
+/// @param flag_c if option encoding is specified
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the option is correctly specified, -1 otherwise.
+int parse_lossless(int flag_l, int flag_a, int flag_b, int flag_c, int verbose);
+
+/// @brief manage error for the sweep options
+/// @param flag_s if option sweep is specified
+/// @param flag_p if option minimum PSNR is specified
+/// @param flag_c if option encoding is specified
+/// @param flag_l if option lossless is specified
+/// @param flag_a if option alpha is specified
+/// @param flag_b if option beta is specified
+/// @param flag_g if option segmentation is specified
+/// @return 0 if options are correctly specified, -1 otherwise.
+int manage_sweep(int flag_s, int flag_p, int flag_c, int flag_l, int flag_a,
+                 int flag_b, int flag_g);
+
+/// @brief parse the list of (alpha, beta) pairs of the sweep option
+/// @param sweep_str list specified in argument: "a1:b1,a2:b2,..."
+/// @param alpha alpha values, to be freed by the caller
+/// @param beta beta values, to be freed by the caller
+/// @param count number of pairs
+/// @return 0 if the parsing was successful, -1 otherwise.
+int parse_sweep(char *sweep_str, double **alpha, double **beta,
+                size_t *count);
+
+/// @brief parse the index option
+/// @param flag_x if option index is specified
+/// @param index_str level specified in argument
+/// @param indexLevel level parsed from index_str
+/// @param flag_c if option encoding is specified
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the parsing was successful, -1 otherwise.
+int parse_index(int flag_x, char *index_str, int *indexLevel, int flag_c,
+                int verbose);
+
+/// @brief parse the decode cache option
+/// @param flag_cache if option cache is specified
+/// @param cache_str size specified in argument, in MB
+/// @param budget size parsed from cache_str, in bytes
+/// @param flag_c if option encoding is specified
+/// @param flag_serve if option serve is specified
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the parsing was successful, -1 otherwise.
+int parse_cache(int flag_cache, char *cache_str, size_t *budget, int flag_c,
+                int flag_serve, int verbose);
+
+/// @brief parse the transform option
+/// @param flag_transform if option transform is specified
+/// @param transform_str name of the transform specified in argument
+/// @param op TRANSFORM_* value parsed from transform_str
+/// @param flag_c if option encoding or requantization is specified
+/// @param flag_u if option decoding is specified
+/// @param flag_l if option lossless is specified
+/// @param flag_g if option segmentation is specified
+/// @param flag_s if option sweep is specified
+/// @param flag_connect if option connect is specified
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the parsing was successful, -1 otherwise.
+int parse_transform(int flag_transform, char *transform_str, int *op,
+                    int flag_c, int flag_u, int flag_l, int flag_g, int flag_s,
+                    int flag_connect, int verbose);
+
+/// @brief manage error for the statistics options
+/// @param flag_stats if option stats is specified
+/// @param flag_region if option region is specified
+/// @param flag_c if option encoding, requantization or transform is
+/// specified
+/// @param flag_u if option decoding is specified
+/// @param flag_l if option lossless is specified
+/// @param flag_g if option segmentation is specified
+/// @param flag_s if option sweep is specified
+/// @param flag_connect if option connect is specified
+/// @return 0 if options are correctly specified, -1 otherwise.
+int manage_stats(int flag_stats, int flag_region, int flag_c, int flag_u,
+                 int flag_l, int flag_g, int flag_s, int flag_connect);
+
+/// @brief parse the region option
+/// @param flag_region if option region is specified
+/// @param region_str region specified in argument, x,y,w,h
+/// @param region x, y, w and h parsed from region_str
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the parsing was successful, -1 otherwise.
+int parse_region(int flag_region, char *region_str, size_t region[4],
+                 int verbose);
+
+/// @brief manage error for the merge and pyramid options
+/// @param flag_merge if option merge is specified
+/// @param flag_pyramid if option pyramid is specified
+/// @param pyramid_str number of tiles per side specified in argument
+/// @param gridWidth number of tiles per side, 2 for a merge
+/// @param flag_c if option encoding, requantization, transform or stats is
+/// specified
+/// @param flag_u if option decoding is specified
+/// @param flag_g if option segmentation is specified
+/// @param flag_s if option sweep is specified
+/// @param flag_connect if option connect is specified
+/// @param extra_inputs number of files following the options
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if options are correctly specified, -1 otherwise.
+int manage_merge(int flag_merge, int flag_pyramid, char *pyramid_str,
+                 size_t *gridWidth, int flag_c, int flag_u, int flag_g,
+                 int flag_s, int flag_connect, size_t extra_inputs,
+                 int verbose);
+
+/// @brief manage error for the pack options
+/// @param flag_pack if option pack is specified
+/// @param flag_unpack if option unpack is specified
+/// @param flag_list if option list is specified
+/// @param flag_c if option encoding, requantization, transform, stats, merge
+/// or pyramid is specified
+/// @param flag_u if option decoding is specified
+/// @param flag_i if option input is specified
+/// @param flag_g if option segmentation is specified
+/// @param flag_s if option sweep is specified
+/// @param flag_connect if option connect is specified
+/// @param extra_inputs number of files following the options
+/// @return 0 if options are correctly specified, -1 otherwise.
+int manage_pack(int flag_pack, int flag_unpack, int flag_list, int flag_c,
+                int flag_u, int flag_i, int flag_g, int flag_s,
+                int flag_connect, size_t extra_inputs);
+
+/// @brief manage error for the sequence option
+/// @param flag_sequence if option sequence is specified
+/// @param flag_c if option encoding is specified
+/// @param flag_u if option decoding is specified
+/// @param flag_other if option requantization, transform, stats, merge,
+/// pyramid, pack, unpack or list is specified
+/// @param flag_x if option index is specified
+/// @param flag_g if option segmentation is specified
+/// @param flag_s if option sweep is specified
+/// @param flag_connect if option connect is specified
+/// @return 0 if options are correctly specified, -1 otherwise.
+int manage_sequence(int flag_sequence, int flag_c, int flag_u, int flag_other,
+                    int flag_x, int flag_g, int flag_s, int flag_connect);
+
 /// @brief print help option
 void print_help();
 
@@ -40,4 +181,29 @@ void print_help();
 /// @return 0 if options are correctly specified, -1 otherwise.
 int manage_CUI(int flag_c, int flag_u, int flag_i);
 
+/// @brief manage error for the requantization option
+/// @param flag_q if option requantize is specified
+/// @param flag_c if option encoding is specified
+/// @param flag_u if option decoding is specified
+/// @param flag_l if option lossless is specified
+/// @param flag_g if option segmentation is specified
+/// @param flag_s if option sweep is specified
+/// @param flag_connect if option connect is specified
+/// @return 0 if options are correctly specified, -1 otherwise.
+int manage_requantize(int flag_q, int flag_c, int flag_u, int flag_l,
+                      int flag_g, int flag_s, int flag_connect);
+
+/// @brief manage error for the server/client options
+/// @param flag_serve if option serve is specified
+/// @param flag_connect if option connect is specified
+/// @param flag_c if option encoding is specified
+/// @param flag_u if option decoding is specified
+/// @param flag_i if option input is specified
+/// @param flag_s if option sweep is specified
+/// @param flag_g if option segmentation is specified
+/// @param extra_inputs 1 if files follow the options, 0 otherwise
+/// @return 0 if options are correctly specified, -1 otherwise.
+int manage_serve(int flag_serve, int flag_connect, int flag_c, int flag_u,
+                 int flag_i, int flag_s, int flag_g, int extra_inputs);
+
 #endif
\ No newline at end of file
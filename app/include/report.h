@@ -0,0 +1,39 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#ifndef _REPORT_H
+#define _REPORT_H
+
+#include "qtc.h"
+
+#include <stddef.h>
+#include <time.h>
+
+/// @brief print the size and PSNR of each pair of a sweep
+/// @param results results of the sweep
+/// @param count number of results
+/// @param best index of the best result, -1 if none
+void print_sweep(SweepResult *results, size_t count, int best);
+
+/// @brief print the minimum, maximum and mean of an image from its
+/// histogram, then the number of pixels of each value present
+/// @param histogram number of pixels of each value
+void print_stats(const size_t histogram[256]);
+
+/// @brief print the mean of a region
+/// @param region x, y, w and h of the region
+/// @param mean mean of the pixels of the region
+void print_region(const size_t region[4], double mean);
+
+/// @brief print the id, name, width and size of each entry of a pack
+/// @param packFile the mapped pack
+void print_pack(const PackFile *packFile);
+
+/// @brief print the time elapsed since start
+/// @param start time taken with timespec_get at the start of the execution
+void print_time(const struct timespec *start);
+
+#endif
@@ -0,0 +1,66 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#ifndef _SERVE_H
+#define _SERVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// operations of a request, same letters as the options
+#define SERVE_ENCODE 'c' // the data is a PGM file, the answer a .qtc file
+#define SERVE_DECODE 'u' // the data is a .qtc file, the answer a PGM file
+
+// largest data of a request, a 32768x32768 PGM file fits
+#define SERVE_MAX_SIZE ((uint64_t)1 << 31)
+
+// seconds a connection may stay idle, or leave its answer unread, before the
+// worker closes it
+#define SERVE_TIMEOUT 30
+
+/// @brief Header of a request, followed by size bytes of data. The socket is
+/// local, so the fields are sent in host byte order.
+typedef struct {
+  uint8_t op;          // SERVE_ENCODE or SERVE_DECODE
+  uint8_t lossless;    // 1 for a lossless encoding
+  uint8_t indexLevel;  // level of the subtree index, 0 for none
+  uint8_t reserved[5]; // 0
+  double alpha;        // alpha value of the encoding
+  double beta;         // beta value of the encoding
+  uint64_t size;       // size of the data
+} ServeRequest;
+
+/// @brief Header of an answer, followed by size bytes of data. The answers
+/// are sent in the order of the requests.
+typedef struct {
+  int32_t status;    // 0 if the request succeeded, -1 otherwise
+  uint32_t reserved; // 0
+  uint64_t size;     // size of the data, 0 if the request failed
+} ServeResponse;
+
+/// @brief serve encode and decode requests on a Unix domain socket until the
+/// process is stopped. Each worker thread accepts connections and answers
+/// their requests in order, so a client can send several requests before
+/// reading the answers.
+/// @param path path of the socket, an existing file is replaced
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return -1 if the socket could not be set up
+int serve(const char *path, int verbose);
+
+/// @brief send requests to a server and write the answers, the requests are
+/// sent without waiting for the answers
+/// @param path path of the socket of the server
+/// @param request header of the requests, size is set for each input
+/// @param inputs files to encode or decode
+/// @param count number of files
+/// @param output name of the output file, only used with a single input
+/// @param flag_o 1 if output file is specified, 0 otherwise
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if every request succeeded, -1 otherwise
+int serve_client(const char *path, ServeRequest request, char **inputs,
+                 size_t count, char *output, int flag_o, int verbose);
+
+#endif
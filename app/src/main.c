@@ -1,22 +1,59 @@
 #include "parse_arg.h"
 #include "qtc.h"
+#include "report.h"
+#include "serve.h"
 #include "verbose.h"
 
 #include <getopt.h>
+#include <stdlib.h>
+#include <time.h>
 
 int main(int argc, char *argv[]) {
 
   // define flag to parse
   int flag_c = 0, flag_u = 0, flag_g = 0, flag_v = 0, flag_i = 0, flag_o = 0,
-      flag_a = 0, flag_b = 0;
+      flag_a = 0, flag_b = 0, flag_l = 0, flag_s = 0, flag_p = 0,
+      flag_x = 0, flag_m = 0, flag_t = 0, flag_q = 0, flag_serve = 0, flag_connect = 0,
+      flag_cache = 0, flag_legacy = 0, flag_transform = 0,
+      flag_stats = 0, flag_region = 0, flag_merge = 0, flag_pyramid = 0,
+      flag_pack = 0, flag_unpack = 0, flag_list = 0, flag_sequence = 0;
   char *input = NULL, *output = NULL;
-  char *alpha_str = NULL, *beta_str = NULL;
+  char *alpha_str = NULL, *beta_str = NULL, *sweep_str = NULL,
+       *psnr_str = NULL, *index_str = NULL, *socket_path = NULL,
+       *cache_str = NULL, *transform_str = NULL, *region_str = NULL,
+       *pyramid_str = NULL, *pack = NULL;
   double alpha = 1.5, beta = 0.8;
+  int indexLevel = 0, transform = 0;
+  size_t cacheBudget = 0;
+  size_t region[4];
+  size_t gridWidth = 0;
   int c;
   extern int opterr;
   opterr = 0;
 
-  while ((c = getopt(argc, argv, "hucgvi:o:a:b:")) != -1) {
+  // long options only, their values are outside the range of the characters
+  enum { OPT_SERVE = 256, OPT_CONNECT, OPT_CACHE, OPT_LEGACY,
+         OPT_TRANSFORM, OPT_STATS, OPT_REGION,
+         OPT_MERGE, OPT_PYRAMID, OPT_PACK, OPT_UNPACK, OPT_LIST,
+         OPT_SEQUENCE };
+  static const struct option long_options[] = {
+      {"serve", required_argument, NULL, OPT_SERVE},
+      {"connect", required_argument, NULL, OPT_CONNECT},
+      {"cache", required_argument, NULL, OPT_CACHE},
+      {"legacy-variance", no_argument, NULL, OPT_LEGACY},
+      {"transform", required_argument, NULL, OPT_TRANSFORM},
+      {"stats", no_argument, NULL, OPT_STATS},
+      {"region", required_argument, NULL, OPT_REGION},
+      {"merge", no_argument, NULL, OPT_MERGE},
+      {"pyramid", required_argument, NULL, OPT_PYRAMID},
+      {"pack", required_argument, NULL, OPT_PACK},
+      {"unpack", required_argument, NULL, OPT_UNPACK},
+      {"list", required_argument, NULL, OPT_LIST},
+      {"sequence", no_argument, NULL, OPT_SEQUENCE},
+      {NULL, 0, NULL, 0}};
+
+  while ((c = getopt_long(argc, argv, "hucqgrlvmti:o:a:b:s:p:x:", long_options,
+                          NULL)) != -1) {
     switch (c) {
     case 'h':
       print_help();
@@ -27,12 +64,27 @@ int main(int argc, char *argv[]) {
     case 'c':
       flag_c = 1;
       break;
+    case 'q':
+      flag_q = 1;
+      break;
     case 'g':
-      flag_g = 1;
+      flag_g |= SEGMENTATION_GRID;
+      break;
+    case 'r':
+      flag_g |= SEGMENTATION_BLOCKS;
+      break;
+    case 'l':
+      flag_l = 1;
       break;
     case 'v':
       flag_v = 1;
       break;
+    case 'm':
+      flag_m = 1;
+      break;
+    case 't':
+      flag_t = 1;
+      break;
     case 'i':
       flag_i = 1;
       input = optarg;
@@ -49,6 +101,66 @@ int main(int argc, char *argv[]) {
       flag_b = 1;
       beta_str = optarg;
       break;
+    case 's':
+      flag_s = 1;
+      sweep_str = optarg;
+      break;
+    case 'p':
+      flag_p = 1;
+      psnr_str = optarg;
+      break;
+    case 'x':
+      flag_x = 1;
+      index_str = optarg;
+      break;
+    case OPT_SERVE:
+      flag_serve = 1;
+      socket_path = optarg;
+      break;
+    case OPT_CONNECT:
+      flag_connect = 1;
+      socket_path = optarg;
+      break;
+    case OPT_CACHE:
+      flag_cache = 1;
+      cache_str = optarg;
+      break;
+    case OPT_LEGACY:
+      flag_legacy = 1;
+      break;
+    case OPT_TRANSFORM:
+      flag_transform = 1;
+      transform_str = optarg;
+      break;
+    case OPT_STATS:
+      flag_stats = 1;
+      break;
+    case OPT_REGION:
+      flag_region = 1;
+      region_str = optarg;
+      break;
+    case OPT_MERGE:
+      flag_merge = 1;
+      break;
+    case OPT_PYRAMID:
+      flag_pyramid = 1;
+      pyramid_str = optarg;
+      break;
+    case OPT_PACK:
+      flag_pack = 1;
+      pack = optarg;
+      break;
+    case OPT_UNPACK:
+      flag_unpack = 1;
+      pack = optarg;
+      break;
+    case OPT_LIST:
+      flag_list = 1;
+      pack = optarg;
+      break;
+    case OPT_SEQUENCE:
+      flag_sequence = 1;
+      break;
 
     default:
       error_arg(optopt);
@@ -63,19 +175,245 @@ int main(int argc, char *argv[]) {
 
   print_verbose(flag_v, "Analyzing program arguments...");
 
+  // huge pages option
+  if (flag_m == 1) {
+    setAllocMode(ALLOC_HUGEPAGES);
+    print_verbose(flag_v, "Huge pages: \x1b[1;32menabled\x1b[0m");
+  }
+
+  // legacy variance option, the filter decisions of the first versions
+  if (flag_legacy == 1) {
+    setVarianceMode(VARIANCE_LEGACY);
+    print_verbose(flag_v, "Legacy variance: \x1b[1;32menabled\x1b[0m");
+  }
+
+  // decode cache option
+  if (parse_cache(flag_cache, cache_str, &cacheBudget, flag_c | flag_q,
+                  flag_serve, flag_v) == -1)
+    return -1;
+  setDecodeCacheBudget(cacheBudget);
+
+  // manage option --serve (server) --connect (client)
+  // the merged tiles, the packed files and the frames follow the options too
+  int flag_tiles = flag_merge | flag_pyramid;
+  int flag_packs = flag_pack | flag_unpack | flag_list;
+  if (manage_serve(flag_serve, flag_connect,
+                   flag_c | flag_q | flag_transform | flag_stats | flag_tiles |
+                       flag_packs | flag_sequence,
+                   flag_u, flag_i, flag_s, flag_g,
+                   optind < argc && flag_tiles == 0 && flag_packs == 0 &&
+                       flag_sequence == 0) == -1)
+    return -1;
+  if (flag_serve == 1) {
+    print_verbose(flag_v, "\x1b[1;4;32mServer mode\n\x1b[0m");
+    return serve(socket_path, flag_v) == -1 ? -1 : 0;
+  }
+
+  // manage option Q (requantize)
+  if (manage_requantize(flag_q, flag_c, flag_u, flag_l, flag_g, flag_s,
+                        flag_connect) == -1)
+    return -1;
+
+  // manage option --transform
+  if (parse_transform(flag_transform, transform_str, &transform,
+                      flag_c | flag_q, flag_u, flag_l, flag_g, flag_s,
+                      flag_connect, flag_v) == -1)
+    return -1;
+
+  // manage option --stats --region
+  if (manage_stats(flag_stats, flag_region, flag_c | flag_q | flag_transform,
+                   flag_u, flag_l, flag_g, flag_s, flag_connect) == -1 ||
+      parse_region(flag_region, region_str, region, flag_v) == -1)
+    return -1;
+
+  // manage option --merge --pyramid, the tiles follow the input
+  if (manage_merge(flag_merge, flag_pyramid, pyramid_str, &gridWidth,
+                   flag_c | flag_q | flag_transform | flag_stats, flag_u,
+                   flag_g, flag_s, flag_connect, argc - optind, flag_v) == -1)
+    return -1;
+
+  // manage option --pack --unpack --list
+  if (manage_pack(flag_pack, flag_unpack, flag_list,
+                  flag_c | flag_q | flag_transform | flag_stats | flag_tiles,
+                  flag_u, flag_i, flag_g, flag_s, flag_connect,
+                  argc - optind) == -1)
+    return -1;
+
+  // manage option --sequence, the frames follow the input
+  if (manage_sequence(flag_sequence, flag_c, flag_u,
+                      flag_q | flag_transform | flag_stats | flag_tiles |
+                          flag_packs,
+                      flag_x, flag_g, flag_s, flag_connect) == -1)
+    return -1;
+
+  // lossless option
+  if (parse_lossless(flag_l, flag_a, flag_b, flag_c | flag_tiles, flag_v) ==
+      -1)
+    return -1;
+
   // parse alpha/beta option
-  if (parse_ab(flag_a, alpha_str, &alpha, flag_b, beta_str, &beta, flag_c,
-               flag_v) == -1)
+  // the requantization takes the encoding parameters
+  if (parse_ab(flag_a, alpha_str, &alpha, flag_b, beta_str, &beta,
+               flag_c | flag_q | flag_tiles, flag_v) == -1)
+    return -1;
+
+  // parse index option
+  if (parse_index(flag_x, index_str, &indexLevel,
+                  flag_c | flag_q | flag_transform | flag_tiles, flag_v) == -1)
     return -1;
 
   // manage option C (encode) U (decode) I (input)
-  if (manage_CUI(flag_c, flag_u, flag_i) == -1)
+  // the pack options were checked on their own
+  if (flag_packs == 0 &&
+      manage_CUI(flag_c | flag_q | flag_transform | flag_stats | flag_tiles,
+                 flag_u, flag_i) == -1)
+    return -1;
+
+  // manage option S (sweep) P (minimum PSNR)
+  if (manage_sweep(flag_s, flag_p, flag_c, flag_l, flag_a, flag_b, flag_g) ==
+      -1)
     return -1;
 
-  if (flag_c == 1) { // encodeur
+  struct timespec start;
+  timespec_get(&start, TIME_UTC);
+
+  if (flag_connect == 1) { // requests sent to a server
+    print_verbose(flag_v, "\x1b[1;4;32mClient mode\n\x1b[0m");
+    // the files following the options are sent after the input
+    ServeRequest request = {flag_c == 1 ? SERVE_ENCODE : SERVE_DECODE,
+                            flag_l,
+                            indexLevel,
+                            {0},
+                            alpha,
+                            beta,
+                            0};
+    size_t count = argc - optind + 1;
+    char **inputs = malloc(count * sizeof(char *));
+    if (inputs == NULL)
+      return -1;
+    inputs[0] = input;
+    for (size_t i = 1; i < count; i++)
+      inputs[i] = argv[optind + i - 1];
+    int status = serve_client(socket_path, request, inputs, count, output,
+                              flag_o, flag_v);
+    free(inputs);
+    if (status == -1)
+      return -1;
+  } else if (flag_s == 1) { // sweep of the encoding parameters
+    double *alphas = NULL, *betas = NULL;
+    size_t count = 0;
+    if (parse_sweep(sweep_str, &alphas, &betas, &count) == -1)
+      return -1;
+    double minPSNR = flag_p == 1 ? strtod(psnr_str, NULL) : -1.;
+    SweepResult *results = malloc(count * sizeof(SweepResult));
+    int best;
+    print_verbose(flag_v, "\x1b[1;4;32mSweep mode\n\x1b[0m");
+    if (results == NULL || sweepImage(input, output, alphas, betas, count,
+                                      results, &best, minPSNR, indexLevel,
+                                      flag_v, flag_o) == -1) {
+      free(alphas);
+      free(betas);
+      free(results);
+      return -1;
+    }
+    print_sweep(results, count, best);
+    free(alphas);
+    free(betas);
+    free(results);
+  } else if (flag_q == 1) { // requantization of a .qtc file
+    print_verbose(flag_v, "\x1b[1;4;32mRequantization mode\n\x1b[0m");
+    if (requantizeImage(input, output, alpha, beta, indexLevel, flag_v,
+                        flag_o))
+      return -1;
+  } else if (flag_transform == 1) { // transform of a .qtc file
+    print_verbose(flag_v, "\x1b[1;4;32mTransform mode\n\x1b[0m");
+    if (transformImage(input, output, transform, indexLevel, flag_v, flag_o))
+      return -1;
+  } else if (flag_stats == 1) { // statistics read from the tree
+    print_verbose(flag_v, "\x1b[1;4;32mStatistics mode\n\x1b[0m");
+    // the file is decoded once for all the queries, the region is checked
+    // before anything is printed
+    SparseQuadTree *sqt = loadDecodeTree(input, flag_v);
+    if (sqt == NULL)
+      return -1;
+    double mean;
+    if (flag_region == 1 && regionMean(sqt, region[0], region[1], region[2],
+                                       region[3], &mean) == -1) {
+      freeDecodeTree(sqt);
+      return -1;
+    }
+    size_t histogram[256];
+    imageHistogram(sqt, histogram);
+    freeDecodeTree(sqt);
+    print_stats(histogram);
+    if (flag_region == 1)
+      print_region(region, mean);
+  } else if (flag_tiles == 1) { // tiles merged on their trees
+    print_verbose(flag_v, "\x1b[1;4;32mMerge mode\n\x1b[0m");
+    // the input is the first tile, the others follow the options
+    size_t count = gridWidth * gridWidth;
+    char **tiles = malloc(count * sizeof(char *));
+    if (tiles == NULL)
+      return -1;
+    tiles[0] = input;
+    for (size_t i = 1; i < count; i++)
+      tiles[i] = argv[optind + i - 1];
+    int status =
+        flag_merge == 1
+            ? mergeImages(tiles, output, alpha, beta, flag_l, indexLevel,
+                          flag_v, flag_o)
+            : buildPyramid(tiles, gridWidth, flag_o == 1 ? output : "out",
+                           alpha, beta, flag_l, indexLevel, flag_v);
+    free(tiles);
+    if (status == -1)
+      return -1;
+  } else if (flag_pack == 1) { // .qtc files stored in a pack
+    print_verbose(flag_v, "\x1b[1;4;32mPack mode\n\x1b[0m");
+    // the input is the first file, the others follow the options
+    size_t count = argc - optind + 1;
+    char **inputs = malloc(count * sizeof(char *));
+    if (inputs == NULL)
+      return -1;
+    inputs[0] = input;
+    for (size_t i = 1; i < count; i++)
+      inputs[i] = argv[optind + i - 1];
+    int status = packFiles(pack, inputs, count, flag_v);
+    free(inputs);
+    if (status == -1)
+      return -1;
+  } else if (flag_unpack == 1) { // entries of a pack extracted or decoded
+    print_verbose(flag_v, "\x1b[1;4;32mUnpack mode\n\x1b[0m");
+    if (unpackFiles(pack, flag_u, flag_v) == -1)
+      return -1;
+  } else if (flag_list == 1) { // index of a pack
+    PackFile packFile;
+    if (openPack(pack, &packFile) == -1)
+      return -1;
+    print_pack(&packFile);
+    closePack(&packFile);
+  } else if (flag_sequence == 1) { // frames coded over the previous one
+    print_verbose(flag_v, "\x1b[1;4;32mSequence mode\n\x1b[0m");
+    // the input is the first frame, the others follow the options
+    size_t count = argc - optind + 1;
+    char **frames = malloc(count * sizeof(char *));
+    if (frames == NULL)
+      return -1;
+    frames[0] = input;
+    for (size_t i = 1; i < count; i++)
+      frames[i] = argv[optind + i - 1];
+    char *prefix = flag_o == 1 ? output : "out";
+    int status = flag_c == 1
+                     ? encodeSequence(frames, count, prefix, alpha, beta,
+                                      flag_l, flag_v)
+                     : decodeSequence(frames, count, prefix, flag_v);
+    free(frames);
+    if (status == -1)
+      return -1;
+  } else if (flag_c == 1) { // encodeur
     print_verbose(flag_v, "\x1b[1;4;32mEncoding mode\n\x1b[0m");
     //  name output file
-    if (encodeImage(input, output, alpha, beta, flag_g, flag_v, flag_o))
+    if (encodeImage(input, output, alpha, beta, flag_l, indexLevel, flag_g,
+                    flag_v, flag_o))
       return -1;
   } else { // decodeur
     print_verbose(flag_v, "\x1b[1;4;32mDecoding mode\x1b[0m");
@@ -84,6 +422,10 @@ int main(int argc, char *argv[]) {
       return -1;
   }
 
+  // timing option, to compare the allocation modes
+  if (flag_t == 1)
+    print_time(&start);
+
   print_verbose(flag_v, "\x1b[1;32mProgram execution successful!\x1b[0m");
   return 0;
 }
\ No newline at end of file
@@ -5,14 +5,23 @@
   =========================================== */
 
 #include "parse_arg.h"
+#include "qtc.h"
+
+#include <math.h>
 
 void error_arg(char arg) {
   // if option is known
-  if (arg == 'i' || arg == 'o' || arg == 'a' || arg == 'b') {
+  if (arg == 'i' || arg == 'o' || arg == 'a' || arg == 'b' || arg == 's' ||
+      arg == 'p' || arg == 'x') {
     fprintf(stderr,
             "\x1b[1;31mInvalid option:\x1b[0m -%c, missing argument.\n"
             "-h for more information\n",
             arg);
+  } else if (arg == 0) {
+    // long options are not reported by their character
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m unknown long option or "
+                    "missing argument.\n"
+                    "-h for more information\n");
   } else {
     fprintf(stderr,
             "\x1b[1;31mInvalid option:\x1b[0m -%c\n"
@@ -33,6 +42,12 @@ int parse_ab(int flag_a, char *alpha_str, double *alpha, int flag_b,
       return -1;
     }
     *alpha = strtod(alpha_str, NULL); // str -> double
+    if (!isfinite(*alpha) || *alpha < 0) {
+      fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -a, the value must "
+                      "be positive.\n"
+                      "-h for more information\n");
+      return -1;
+    }
     // verbose message
     sprintf(message, "\x1b[4mAlpha value\x1b[0m : \x1b[1;35m%.2f\x1b[0m",
             *alpha);
@@ -48,6 +63,12 @@ int parse_ab(int flag_a, char *alpha_str, double *alpha, int flag_b,
       return -1;
     }
     *beta = strtod(beta_str, NULL); // str -> double
+    if (!isfinite(*beta) || *beta < 0) {
+      fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -b, the value must "
+                      "be positive.\n"
+                      "-h for more information\n");
+      return -1;
+    }
     // verbose message
     sprintf(message, "\x1b[4mBeta  value\x1b[0m : \x1b[1;35m%.2f\x1b[0m",
             *beta);
@@ -56,23 +77,432 @@ int parse_ab(int flag_a, char *alpha_str, double *alpha, int flag_b,
   return 0;
 }
 
+int parse_lossless(int flag_l, int flag_a, int flag_b, int flag_c,
+                   int verbose) {
+  if (flag_l == 0)
+    return 0;
+  if (flag_c == 0) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -l, option only "
+                    "available for encoding.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  // alpha and beta are only used by the filter
+  if (flag_a == 1 || flag_b == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -l, cannot be used "
+                    "with -a or -b.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  print_verbose(verbose, "Lossless mode: \x1b[1;32menabled\x1b[0m");
+  return 0;
+}
+
+int manage_sweep(int flag_s, int flag_p, int flag_c, int flag_l, int flag_a,
+                 int flag_b, int flag_g) {
+  if (flag_s == 0) {
+    if (flag_p == 1) {
+      fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -p, option only "
+                      "available with -s.\n"
+                      "-h for more information\n");
+      return -1;
+    }
+    return 0;
+  }
+  if (flag_c == 0) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -s, option only "
+                    "available for encoding.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  // the sweep gives its own alpha and beta values
+  if (flag_l == 1 || flag_a == 1 || flag_b == 1 || flag_g == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -s, cannot be used "
+                    "with -l, -a, -b, -g or -r.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  return 0;
+}
+
+int parse_sweep(char *sweep_str, double **alpha, double **beta,
+                size_t *count) {
+  // one pair per comma
+  size_t n = 1;
+  for (char *c = sweep_str; *c != '\0'; c++)
+    if (*c == ',')
+      n++;
+  *alpha = malloc(n * sizeof(double));
+  *beta = malloc(n * sizeof(double));
+  if (*alpha == NULL || *beta == NULL) {
+    free(*alpha);
+    free(*beta);
+    return -1;
+  }
+
+  char *cur = sweep_str;
+  for (size_t i = 0; i < n; i++) {
+    char *end;
+    (*alpha)[i] = strtod(cur, &end);
+    if (end == cur || *end != ':')
+      break;
+    cur = end + 1;
+    (*beta)[i] = strtod(cur, &end);
+    if (end == cur || (*end != ',' && *end != '\0') ||
+        !isfinite((*alpha)[i]) || (*alpha)[i] < 0 || !isfinite((*beta)[i]) ||
+        (*beta)[i] < 0)
+      break;
+    cur = end + 1;
+    if (i == n - 1) {
+      *count = n;
+      return 0;
+    }
+  }
+  fprintf(stderr,
+          "\x1b[1;31mInvalid option:\x1b[0m -s, expected a list of positive "
+          "alpha:beta pairs separated by commas.\n"
+          "-h for more information\n");
+  free(*alpha);
+  free(*beta);
+  return -1;
+}
+
+int parse_index(int flag_x, char *index_str, int *indexLevel, int flag_c,
+                int verbose) {
+  if (flag_x == 0)
+    return 0;
+  if (flag_c == 0) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -x, option only "
+                    "available for encoding.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  char *end;
+  long level = strtol(index_str, &end, 10);
+  if (end == index_str || *end != '\0' || level < 1 || level > 8) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -x, the level must be "
+                    "between 1 and 8.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  *indexLevel = (int)level;
+  char message[100];
+  sprintf(message, "\x1b[4mIndex level\x1b[0m : \x1b[1;35m%d\x1b[0m",
+          *indexLevel);
+  print_verbose(verbose, message);
+  return 0;
+}
+
+int parse_cache(int flag_cache, char *cache_str, size_t *budget, int flag_c,
+                int flag_serve, int verbose) {
+  if (flag_cache == 0)
+    return 0;
+  if (flag_c == 1 && flag_serve == 0) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --cache, option only "
+                    "available for decoding or serving.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  char *end;
+  long long size = strtoll(cache_str, &end, 10);
+  // the budget is given in MB and must fit in a size_t once converted
+  if (end == cache_str || *end != '\0' || size < 1 ||
+      (unsigned long long)size > SIZE_MAX >> 20) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --cache, the size "
+                    "must be a positive number of MB.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  *budget = (size_t)size << 20;
+  char message[100];
+  sprintf(message, "\x1b[4mDecode cache\x1b[0m : \x1b[1;35m%lld\x1b[0m MB",
+          size);
+  print_verbose(verbose, message);
+  return 0;
+}
+
+int parse_transform(int flag_transform, char *transform_str, int *op,
+                    int flag_c, int flag_u, int flag_l, int flag_g, int flag_s,
+                    int flag_connect, int verbose) {
+  if (flag_transform == 0)
+    return 0;
+  // the tree is only reordered or cut, there are no pixels to filter
+  if (flag_c == 1 || flag_u == 1 || flag_l == 1 || flag_g != 0 ||
+      flag_s == 1 || flag_connect == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --transform, cannot "
+                    "be used with -c, -u, -q, -l, -g, -r, -s or --connect.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  // in the order of the TRANSFORM_* values
+  static const char *names[] = {"hflip",   "vflip",   "rot90",
+                                "rot180",  "rot270",  "crop-tl",
+                                "crop-tr", "crop-br", "crop-bl"};
+  for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+    if (strcmp(transform_str, names[i]) == 0) {
+      *op = i;
+      char message[100];
+      sprintf(message, "\x1b[4mTransform\x1b[0m : \x1b[1;35m%s\x1b[0m",
+              names[i]);
+      print_verbose(verbose, message);
+      return 0;
+    }
+  }
+  fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --transform, expected "
+                  "hflip, vflip, rot90, rot180, rot270, crop-tl, crop-tr, "
+                  "crop-br or crop-bl.\n"
+                  "-h for more information\n");
+  return -1;
+}
+
+int manage_stats(int flag_stats, int flag_region, int flag_c, int flag_u,
+                 int flag_l, int flag_g, int flag_s, int flag_connect) {
+  if (flag_region == 1 && flag_stats == 0) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --region, option only "
+                    "available with --stats.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  if (flag_stats == 0)
+    return 0;
+  // the statistics are read from the tree, nothing is written
+  if (flag_c == 1 || flag_u == 1 || flag_l == 1 || flag_g != 0 ||
+      flag_s == 1 || flag_connect == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --stats, cannot be "
+                    "used with -c, -u, -q, -l, -g, -r, -s, --transform or "
+                    "--connect.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  return 0;
+}
+
+int parse_region(int flag_region, char *region_str, size_t region[4],
+                 int verbose) {
+  if (flag_region == 0)
+    return 0;
+  // x,y,w,h: four numbers separated by commas
+  char *cur = region_str;
+  for (int i = 0; i < 4; i++) {
+    char *end;
+    if (*cur < '0' || *cur > '9') // strtoull would accept a sign
+      break;
+    unsigned long long value = strtoull(cur, &end, 10);
+    if (end == cur || value > SIZE_MAX || *end != (i == 3 ? '\0' : ','))
+      break;
+    region[i] = (size_t)value;
+    cur = end + 1;
+    if (i == 3) {
+      char message[100];
+      sprintf(message,
+              "\x1b[4mRegion\x1b[0m : \x1b[1;35m%zux%zu\x1b[0m at "
+              "(\x1b[1;35m%zu\x1b[0m, \x1b[1;35m%zu\x1b[0m)",
+              region[2], region[3], region[0], region[1]);
+      print_verbose(verbose, message);
+      return 0;
+    }
+  }
+  fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --region, expected "
+                  "x,y,w,h.\n"
+                  "-h for more information\n");
+  return -1;
+}
+
+int manage_merge(int flag_merge, int flag_pyramid, char *pyramid_str,
+                 size_t *gridWidth, int flag_c, int flag_u, int flag_g,
+                 int flag_s, int flag_connect, size_t extra_inputs,
+                 int verbose) {
+  if (flag_merge == 0 && flag_pyramid == 0)
+    return 0;
+  // the tiles are merged on their trees, there are no pixels to segment
+  if (flag_merge == 1 && flag_pyramid == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --merge, cannot be "
+                    "used with --pyramid.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  if (flag_c == 1 || flag_u == 1 || flag_g != 0 || flag_s == 1 ||
+      flag_connect == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --merge and "
+                    "--pyramid cannot be used with -c, -u, -q, -g, -r, -s, "
+                    "--transform, --stats or --connect.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  if (flag_merge == 1) {
+    *gridWidth = 2;
+  } else {
+    char *end;
+    long width = strtol(pyramid_str, &end, 10);
+    if (end == pyramid_str || *end != '\0' || width < 2 || width > 1 << 15 ||
+        (width & (width - 1)) != 0) {
+      fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --pyramid, the "
+                      "number of tiles per side must be a power of two "
+                      "(2 to 32768).\n"
+                      "-h for more information\n");
+      return -1;
+    }
+    *gridWidth = (size_t)width;
+  }
+  // the input is the first tile, the others follow the options
+  if (extra_inputs + 1 != *gridWidth * *gridWidth) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m %s, expected %zu "
+                    "tiles, got %zu.\n"
+                    "-h for more information\n",
+            flag_merge == 1 ? "--merge" : "--pyramid",
+            *gridWidth * *gridWidth, extra_inputs + 1);
+    return -1;
+  }
+  char message[100];
+  sprintf(message, "\x1b[4mTiles\x1b[0m : \x1b[1;35m%zux%zu\x1b[0m",
+          *gridWidth, *gridWidth);
+  print_verbose(verbose, message);
+  return 0;
+}
+
+int manage_pack(int flag_pack, int flag_unpack, int flag_list, int flag_c,
+                int flag_u, int flag_i, int flag_g, int flag_s,
+                int flag_connect, size_t extra_inputs) {
+  if (flag_pack == 0 && flag_unpack == 0 && flag_list == 0)
+    return 0;
+  if (flag_pack + flag_unpack + flag_list > 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --pack, --unpack and "
+                    "--list cannot be used together.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  if (flag_c == 1 || flag_g != 0 || flag_s == 1 || flag_connect == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --pack, --unpack and "
+                    "--list cannot be used with -c, -q, -g, -r, -s, "
+                    "--transform, --stats, --merge, --pyramid or "
+                    "--connect.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  // the files to pack are the input and the files following the options
+  if (flag_pack == 1) {
+    if (flag_u == 1) {
+      fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --pack, cannot be "
+                      "used with -u.\n"
+                      "-h for more information\n");
+      return -1;
+    }
+    if (flag_i == 0) {
+      fprintf(stderr, "\x1b[1;31mMissing option:\x1b[0m -i.\n"
+                      "-h for more information\n");
+      return -1;
+    }
+    return 0;
+  }
+  // the pack is the only input, -u decodes its entries
+  if (flag_i == 1 || extra_inputs != 0) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m %s, the pack is the "
+                    "only input.\n"
+                    "-h for more information\n",
+            flag_unpack == 1 ? "--unpack" : "--list");
+    return -1;
+  }
+  if (flag_list == 1 && flag_u == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --list, cannot be "
+                    "used with -u.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  return 0;
+}
+
+int manage_sequence(int flag_sequence, int flag_c, int flag_u, int flag_other,
+                    int flag_x, int flag_g, int flag_s, int flag_connect) {
+  if (flag_sequence == 0)
+    return 0;
+  if (flag_c == 0 && flag_u == 0) {
+    fprintf(stderr, "\x1b[1;31mMissing option:\x1b[0m -c or -u.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  // the frames after the first one have no index and no grid
+  if (flag_other == 1 || flag_x == 1 || flag_g != 0 || flag_s == 1 ||
+      flag_connect == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --sequence, cannot be "
+                    "used with -q, -x, -g, -r, -s, --transform, --stats, "
+                    "--merge, --pyramid, --pack, --unpack, --list or "
+                    "--connect.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  return 0;
+}
+
 void print_help() {
   printf(
       "Usage: ./codec [options]\n"
       "Options:\n"
       "    -u          : Decoding mode.\n"
       "    -c          : Coding mode.\n"
+      "    -q          : Requantization mode, the .qtc input is filtered again "
+      "with -a and -b.\n"
       "    -i <input>  : Input file (pgm/qtc format) [mandatory].\n"
       "    -o <output> : Output file (pgm/qtc format). Defaults: 'out.pgm'.\n"
       "    -g          : Enable segmentation grid.\n"
+      "    -r          : Write the segmentation blocks (x y size intensity) "
+      "in a text file.\n"
+      "    -l          : Lossless encoding, no filtering is applied.\n"
       "    -a <number> : Set the alpha value. Default: 1.5. Recommended: 1 < "
       "alpha for optimal rendering.\n"
       "    -b <number> : Set the beta value. Default: 0.8. Recommended: 0 < "
       "beta < 1 for optimal rendering.\n"
+      "    -s <a:b,..> : Sweep the (alpha, beta) pairs, the size and PSNR of "
+      "each pair are reported.\n"
+      "    -p <number> : With -s, write the smallest result whose PSNR is at "
+      "least this value.\n"
+      "    -x <level>  : Write a subtree index at this level (1 to 8) for "
+      "parallel decoding.\n"
+      "    -m          : Allocate the node arrays and pixmaps in huge pages "
+      "when available.\n"
+      "    -t          : Print the execution time.\n"
+      "    --serve <socket>   : Serve encode/decode requests on a Unix "
+      "socket.\n"
+      "    --connect <socket> : Send the input (and the files following the "
+      "options) to a server.\n"
+      "    --legacy-variance  : Filter with the variance approximation of the "
+      "first versions.\n"
+      "    --cache <MB>       : Keep the decoded images in memory, a file "
+      "decoded again is copied.\n"
+      "    --transform <op>   : Write a transformed copy of the .qtc input, "
+      "op is hflip, vflip,\n"
+      "                         rot90, rot180, rot270 (clockwise) or "
+      "crop-tl, crop-tr, crop-br, crop-bl.\n"
+      "    --stats            : Print the minimum, maximum, mean and "
+      "histogram of the .qtc input.\n"
+      "    --region <x,y,w,h> : With --stats, also print the mean of this "
+      "region.\n"
+      "    --merge            : Merge the input and the 3 .qtc tiles "
+      "following the options (row by row)\n"
+      "                         into their parent tile.\n"
+      "    --pyramid <n>      : Build the pyramid above the input and the "
+      "n*n-1 .qtc tiles following\n"
+      "                         the options (row by row), written in "
+      "QTC/<output>_<level>_<row>_<col>.qtc.\n"
+      "    --pack <pack>      : Store the .qtc input and the .qtc files "
+      "following the options in a pack,\n"
+      "                         appended to it if it exists.\n"
+      "    --unpack <pack>    : Extract the entries of a pack in "
+      "QTC/<name>.qtc, or decode them in\n"
+      "                         PGM/<name>.pgm with -u.\n"
+      "    --list <pack>      : Print the entries of a pack.\n"
+      "    --sequence         : With -c, encode the input and the frames "
+      "following the options, each one\n"
+      "                         over the previous one, in "
+      "QTC/<output>_<k>.qtc. With -u, decode them\n"
+      "                         in PGM/<output>_<k>.pgm.\n"
       "    -v          : Enable verbose mode. Default: silent.\n"
       "    -h          : Show this help message.\n"
       "\n"
-      "Note: The options -a and -b are only allowed in encoding mode.\n");
+      "Note: The options -a, -b, -l, -s and -x are only allowed in encoding "
+      "mode, -a, -b and -x also in requantization mode, -x also with "
+      "--transform,\n"
+      "-a, -b, -l and -x also with --merge and --pyramid, -a, -b and -l also "
+      "with --sequence.\n");
 }
 
 int manage_CUI(int flag_c, int flag_u, int flag_i) {
@@ -90,4 +520,53 @@ int manage_CUI(int flag_c, int flag_u, int flag_i) {
     return -1;
   }
   return 0;
-}
\ No newline at end of file
+}
+
+int manage_requantize(int flag_q, int flag_c, int flag_u, int flag_l,
+                      int flag_g, int flag_s, int flag_connect) {
+  if (flag_q == 0)
+    return 0;
+  if (flag_c == 1 || flag_u == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -q, cannot be used "
+                    "with -c or -u.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  // the tree is only filtered again, there are no pixels to segment
+  if (flag_l == 1 || flag_g != 0 || flag_s == 1 || flag_connect == 1) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m -q, cannot be used "
+                    "with -l, -g, -r, -s or --connect.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  return 0;
+}
+
+int manage_serve(int flag_serve, int flag_connect, int flag_c, int flag_u,
+                 int flag_i, int flag_s, int flag_g, int extra_inputs) {
+  if (flag_serve == 1) {
+    // the requests give their own parameters
+    if (flag_connect == 1 || flag_c == 1 || flag_u == 1 || flag_i == 1) {
+      fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --serve, cannot be "
+                      "used with --connect, -c, -u or -i.\n"
+                      "-h for more information\n");
+      return -1;
+    }
+    return 0;
+  }
+  if (flag_connect == 1 && (flag_s == 1 || flag_g != 0)) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m --connect, cannot be "
+                    "used with -s, -g or -r.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  // only the client, the tiles, the packs and the frames take several inputs
+  if (flag_connect == 0 && extra_inputs) {
+    fprintf(stderr, "\x1b[1;31mInvalid option:\x1b[0m several inputs are "
+                    "only allowed with --connect, --merge, --pyramid, "
+                    "--pack or --sequence.\n"
+                    "-h for more information\n");
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#include "report.h"
+
+#include <math.h>
+#include <stdio.h>
+
+void print_sweep(SweepResult *results, size_t count, int best) {
+  printf("  alpha    beta      size (bytes)    PSNR (dB)\n");
+  for (size_t i = 0; i < count; i++) {
+    printf("%c %-8.3f %-8.3f  %-14zu  ", (int)i == best ? '*' : ' ',
+           results[i].alpha, results[i].beta, results[i].size);
+    if (isinf(results[i].psnr))
+      printf("inf\n");
+    else
+      printf("%.2f\n", results[i].psnr);
+  }
+}
+
+void print_stats(const size_t histogram[256]) {
+  size_t count = 0;
+  double sum = 0;
+  int min = -1, max = -1;
+  for (int v = 0; v < 256; v++) {
+    if (histogram[v] == 0)
+      continue;
+    min = min == -1 ? v : min;
+    max = v;
+    count += histogram[v];
+    sum += (double)v * histogram[v];
+  }
+  printf("min %d  max %d  mean %.3f  pixels %zu\n", min, max, sum / count,
+         count);
+  printf("value  pixels\n");
+  for (int v = 0; v < 256; v++)
+    if (histogram[v] != 0)
+      printf("%-5d  %zu\n", v, histogram[v]);
+}
+
+void print_region(const size_t region[4], double mean) {
+  printf("region %zux%zu at (%zu, %zu): mean %.3f\n", region[2], region[3],
+         region[0], region[1], mean);
+}
+
+void print_pack(const PackFile *packFile) {
+  printf("id     name                  width   size (bytes)\n");
+  for (size_t id = 0; id < packFile->count; id++) {
+    const PackEntry *entry = &packFile->entries[id];
+    printf("%-5zu  %-20s  %-6u  %llu\n", id, entry->name,
+           (unsigned)entry->width, (unsigned long long)entry->size);
+  }
+}
+
+void print_time(const struct timespec *start) {
+  struct timespec end;
+  timespec_get(&end, TIME_UTC);
+  double ms = (end.tv_sec - start->tv_sec) * 1e3 +
+              (end.tv_nsec - start->tv_nsec) / 1e6;
+  printf("Execution time: %.3f ms\n", ms);
+}
@@ -0,0 +1,385 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+// sockets and threads are not part of C17
+#define _DEFAULT_SOURCE
+
+#include "serve.h"
+#include "qtc.h"
+#include "verbose.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// @brief Shared state of the workers
+typedef struct {
+  int listener; // listening socket
+  int verbose;  // 1 if verbose mode is enabled, 0 otherwise
+} Server;
+
+/// @brief read exactly n bytes from a socket
+/// @param fd socket to read from
+/// @param buffer buffer to fill
+/// @param n number of bytes to read
+/// @return 0 if successful, 1 if the connection was closed before the first
+/// byte, -1 otherwise
+static int read_full(int fd, void *buffer, size_t n) {
+  unsigned char *cur = buffer;
+  size_t done = 0;
+  while (done < n) {
+    ssize_t r = read(fd, cur + done, n - done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return r == 0 && done == 0 ? 1 : -1;
+    done += r;
+  }
+  return 0;
+}
+
+/// @brief write exactly n bytes to a socket
+/// @param fd socket to write to
+/// @param buffer bytes to write
+/// @param n number of bytes to write
+/// @return 0 if successful, -1 otherwise
+static int write_full(int fd, const void *buffer, size_t n) {
+  const unsigned char *cur = buffer;
+  size_t done = 0;
+  while (done < n) {
+    ssize_t w = write(fd, cur + done, n - done);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return -1;
+    done += w;
+  }
+  return 0;
+}
+
+/// @brief check the parameters of a request, as the options of an encoding
+/// are checked
+/// @param request header of the request
+/// @return 0 if the request can be answered, -1 otherwise
+static int check_request(const ServeRequest *request) {
+  if (request->op == SERVE_DECODE)
+    return 0;
+  if (request->lossless > 1 || request->indexLevel > 8)
+    return -1;
+  // alpha and beta are only used by the filter
+  if (request->lossless == 0 &&
+      (!isfinite(request->alpha) || request->alpha < 0 ||
+       !isfinite(request->beta) || request->beta < 0))
+    return -1;
+  return 0;
+}
+
+/// @brief answer the requests of a connection until it is closed or idle
+/// for SERVE_TIMEOUT seconds
+/// @param fd connection
+/// @param server shared state of the workers
+/// @param data request buffer of the worker, kept from one request to the
+/// next
+/// @param capacity size of the request buffer
+/// @param buffers trees and answer buffer of the worker, kept from one
+/// request to the next
+static void serve_connection(int fd, const Server *server, unsigned char **data,
+                             size_t *capacity, CodecBuffers *buffers) {
+  char message[100];
+  ServeRequest request;
+  int status;
+  while ((status = read_full(fd, &request, sizeof(request))) == 0) {
+    if (request.op != SERVE_ENCODE && request.op != SERVE_DECODE)
+      return;
+    // the size is checked before anything is allocated. The data of a larger
+    // request is not read, so the connection ends with its answer.
+    if (request.size > SERVE_MAX_SIZE) {
+      sprintf(message, "Request of %llu bytes: too large",
+              (unsigned long long)request.size);
+      print_verbose(server->verbose, message);
+      ServeResponse response = {-1, 0, 0};
+      write_full(fd, &response, sizeof(response));
+      return;
+    }
+    // the buffer only grows, so repeated requests do not allocate
+    if (request.size > *capacity) {
+      unsigned char *grown = realloc(*data, request.size);
+      if (grown == NULL)
+        return;
+      *data = grown;
+      *capacity = request.size;
+    }
+    if (read_full(fd, *data, request.size) != 0)
+      return;
+
+    // the answer is held by the buffers of the worker until the next request
+    const unsigned char *answer = NULL;
+    size_t size = 0;
+    // an invalid request is answered as failed, the next ones are still read
+    status = check_request(&request);
+    if (status == 0)
+      status = request.op == SERVE_ENCODE
+                   ? encodeMemoryBuffered(buffers, *data, request.size,
+                                          request.alpha, request.beta,
+                                          request.lossless, request.indexLevel,
+                                          &answer, &size, 0)
+                   : decodeMemoryBuffered(buffers, *data, request.size,
+                                          &answer, &size, 0);
+    sprintf(message, "%s request of %zu bytes: %s",
+            request.op == SERVE_ENCODE ? "Encode" : "Decode",
+            (size_t)request.size, status == 0 ? "done" : "failed");
+    print_verbose(server->verbose, message);
+    if (request.op == SERVE_DECODE) {
+      DecodeCacheStats stats;
+      getDecodeCacheStats(&stats);
+      if (stats.budget != 0) {
+        sprintf(message,
+                "Decode cache: %zu hits, %zu misses, %zu entries, %zu bytes",
+                stats.hits, stats.misses, stats.entries, stats.bytes);
+        print_verbose(server->verbose, message);
+      }
+    }
+    // the server runs for long, its log must not wait for a full buffer
+    fflush(stdout);
+
+    ServeResponse response = {status == 0 ? 0 : -1, 0, status == 0 ? size : 0};
+    int sent = write_full(fd, &response, sizeof(response));
+    if (sent == 0 && status == 0)
+      sent = write_full(fd, answer, size);
+    if (sent == -1)
+      return;
+  }
+  if (status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    sprintf(message, "Connection idle for %d s: closed", SERVE_TIMEOUT);
+    print_verbose(server->verbose, message);
+    fflush(stdout);
+  }
+}
+
+/// @brief accept connections and answer them one after the other
+/// @param arg shared state of the workers
+/// @return NULL
+static void *worker(void *arg) {
+  const Server *server = arg;
+  unsigned char *data = NULL;
+  size_t capacity = 0;
+  CodecBuffers *buffers = createCodecBuffers();
+  if (buffers == NULL)
+    return NULL;
+  // a client that stops sending or reading must not hold the worker
+  struct timeval timeout = {SERVE_TIMEOUT, 0};
+  for (;;) {
+    int fd = accept(server->listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    serve_connection(fd, server, &data, &capacity, buffers);
+    close(fd);
+  }
+  free(data);
+  freeCodecBuffers(buffers);
+  return NULL;
+}
+
+/// @brief fill the address of a socket
+/// @param addr address to fill
+/// @param path path of the socket
+/// @return 0 if successful, -1 if the path is too long
+static int socket_address(struct sockaddr_un *addr, const char *path) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: socket path too long\n");
+    return -1;
+  }
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+int serve(const char *path, int verbose) {
+  struct sockaddr_un addr;
+  if (socket_address(&addr, path) == -1)
+    return -1;
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: socket could not be created\n");
+    return -1;
+  }
+  // a socket left by a previous server is replaced
+  unlink(path);
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listener, SOMAXCONN) != 0) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: socket could not be bound\n");
+    close(listener);
+    return -1;
+  }
+  // a client leaving early must not stop the server
+  signal(SIGPIPE, SIG_IGN);
+
+  long numCPU = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t numThreads = numCPU < 1 ? 1 : (size_t)numCPU;
+  char message[sizeof(addr.sun_path) + 100];
+  snprintf(message, sizeof(message),
+           "Serving on \x1b[1;35m%s\x1b[0m with \x1b[1;35m%zu\x1b[0m "
+           "workers",
+           path, numThreads);
+  print_verbose(verbose, message);
+
+  // the current thread is the last worker
+  Server server = {listener, verbose};
+  pthread_t threads[numThreads];
+  size_t started = 0;
+  for (; started < numThreads - 1; started++)
+    if (pthread_create(&threads[started], NULL, worker, &server) != 0)
+      break;
+  worker(&server);
+  for (size_t t = 0; t < started; t++)
+    pthread_join(threads[t], NULL);
+  close(listener);
+  unlink(path);
+  return 0;
+}
+
+/// @brief name the file of an answer: QTC/<name>.qtc or PGM/<name>.pgm,
+/// where name is the output option or the name of the input
+/// @param filename_out name to fill
+/// @param len size of filename_out
+/// @param op operation of the request
+/// @param input name of the input file
+/// @param output name of the output file, NULL to use the input
+static void name_answer(char *filename_out, size_t len, int op,
+                        const char *input, const char *output) {
+  const char *name = output;
+  if (name == NULL) {
+    const char *slash = strrchr(input, '/');
+    name = slash == NULL ? input : slash + 1;
+  }
+  const char *dot = strrchr(name, '.');
+  int n = dot == NULL || dot == name ? (int)strlen(name) : (int)(dot - name);
+  snprintf(filename_out, len, "%s%.*s%s", op == SERVE_ENCODE ? "QTC/" : "PGM/",
+           n, name, op == SERVE_ENCODE ? ".qtc" : ".pgm");
+}
+
+/// @brief Requests sent by the client
+typedef struct {
+  int fd;               // connection
+  ServeRequest request; // header of the requests
+  char **inputs;        // files to send
+  size_t count;         // number of files
+  size_t sent;          // number of requests sent
+  int verbose;          // 1 if verbose mode is enabled, 0 otherwise
+} Sender;
+
+/// @brief send the requests, the answers are read at the same time by the
+/// caller so that neither side blocks on a full socket
+/// @param arg the requests
+/// @return NULL
+static void *send_requests(void *arg) {
+  Sender *sender = arg;
+  char message[300];
+  for (; sender->sent < sender->count; sender->sent++) {
+    const char *input = sender->inputs[sender->sent];
+    size_t size;
+    unsigned char *data = loadFile(input, &size);
+    if (data == NULL) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: could not read %s\n", input);
+      break;
+    }
+    sender->request.size = size;
+    int status = write_full(sender->fd, &sender->request,
+                            sizeof(sender->request));
+    if (status == 0)
+      status = write_full(sender->fd, data, size);
+    free(data);
+    if (status == -1)
+      break;
+    sprintf(message, "Sent \x1b[1;35m%.200s\x1b[0m", input);
+    print_verbose(sender->verbose, message);
+  }
+  // no more requests, the server closes the connection after the answers
+  shutdown(sender->fd, SHUT_WR);
+  return NULL;
+}
+
+int serve_client(const char *path, ServeRequest request, char **inputs,
+                 size_t count, char *output, int flag_o, int verbose) {
+  struct sockaddr_un addr;
+  if (socket_address(&addr, path) == -1)
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: could not connect to %s\n", path);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+
+  // the requests are pipelined: they are all sent without waiting for the
+  // answers
+  Sender sender = {fd, request, inputs, count, 0, verbose};
+  pthread_t thread;
+  int threaded = pthread_create(&thread, NULL, send_requests, &sender) == 0;
+  if (!threaded)
+    send_requests(&sender);
+
+  char message[300];
+  int result = 0;
+  size_t received = 0;
+  for (;; received++) {
+    ServeResponse response;
+    int status = read_full(fd, &response, sizeof(response));
+    if (status != 0) {
+      result = status == 1 ? result : -1;
+      break;
+    }
+    unsigned char *data = malloc(response.size == 0 ? 1 : response.size);
+    if (data == NULL || read_full(fd, data, response.size) == -1) {
+      free(data);
+      result = -1;
+      break;
+    }
+    const char *input = inputs[received];
+    if (response.status != 0) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be %s\n", input,
+              request.op == SERVE_ENCODE ? "encoded" : "decoded");
+      result = -1;
+    } else {
+      char filename_out[300];
+      name_answer(filename_out, sizeof(filename_out), request.op, input,
+                  flag_o == 1 && count == 1 ? output : NULL);
+      FILE *file = fopen(filename_out, "wb");
+      if (file == NULL ||
+          fwrite(data, 1, response.size, file) != response.size) {
+        fprintf(stderr, "\x1b[1;31mError\x1b[0m: could not write %s\n",
+                filename_out);
+        result = -1;
+      } else {
+        sprintf(message, "Saved \x1b[1;35m%.200s\x1b[0m", filename_out);
+        print_verbose(verbose, message);
+      }
+      if (file != NULL)
+        fclose(file);
+    }
+    free(data);
+  }
+  if (threaded)
+    pthread_join(thread, NULL);
+  close(fd);
+  // every request must have been sent and answered
+  return result == 0 && sender.sent == count && received == count ? 0 : -1;
+}
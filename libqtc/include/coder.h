@@ -8,21 +8,143 @@
 #define _CODER_H_
 
 #include "quadtree.h"
+#include "sparse_quadtree.h"
 
+#include <stdint.h>
 #include <stdio.h>
 
+/// @brief Undo log of a filter pass: the nodes uniformized by the filter and
+/// their values before the pass.
+typedef struct {
+  size_t *index;   // indices of the uniformized nodes
+  Node *node;      // nodes before they were uniformized
+  size_t count;    // number of logged nodes
+  size_t capacity; // number of nodes the log can hold
+} FilterLog;
+
+// maximum level of the subtree index (4^8 subtrees)
+#define QTC_MAX_INDEX_LEVEL 8
+
+// fixed size header at the start of a .qtc file
+#define QTC_MAGIC "QTCB"
+#define QTC_VERSION 1
+#define QTC_HEADER_SIZE 32
+// flags of the header
+#define QTC_FLAG_INDEXED 1 // the bitstream is preceded by a subtree index
+#define QTC_FLAG_INTER 2   // frame coded against the previous frame
+// the payload of an inter frame starts with two hashes (8 bytes each), see
+// hashQuadTree: the frame it is coded over and the frame it decodes to
+#define QTC_FRAME_IDS_SIZE 16
+
+/// @brief Header of a .qtc file, stored in QTC_HEADER_SIZE bytes with its
+/// integers in little endian: magic number (4 bytes), version, depth, levels,
+/// indexLevel (1 byte each), flags, width, height, metadataSize (4 bytes each)
+/// and payloadSize (8 bytes). The metadata follows the header, then the
+/// payload: the subtree index if there is one, and the bitstream.
+typedef struct {
+  unsigned char version;    // QTC_VERSION
+  unsigned char depth;      // bits per pixel
+  unsigned char levels;     // height of the quadtree
+  unsigned char indexLevel; // level of the subtree index, 0 if there is none
+  uint32_t flags;           // combination of QTC_FLAG_*
+  uint32_t width;           // width of the image in pixels
+  uint32_t height;          // height of the image in pixels
+  uint32_t metadataSize;    // size of the metadata, 0 if there is none
+  uint64_t payloadSize;     // size of the index and the bitstream
+} QTCHeader;
+
 /// @brief Writes the QuadTree to a file in a lossless format.
 /// @param qt The QuadTree to write.
 /// @param filename The name of the file to write to.
+/// @param indexLevel 0 for no index, otherwise the bitstream is split in the
+/// 4^indexLevel subtrees of this level and their offsets are stored in the
+/// header. It is clamped to numLevels - 1 and QTC_MAX_INDEX_LEVEL.
+/// @param metadata comment lines (each starting with '#') stored after the
+/// header, NULL for none.
 /// @param verbose 1 if verbose mode is enabled, 0 otherwise.
 /// @return 0 if successful, -1 if the file could not be opened.
-int QTC_encoder(QuadTree *qt, const char *filename, int verbose);
+int QTC_encoder(QuadTree *qt, const char *filename, unsigned char indexLevel,
+                const char *metadata, int verbose);
+
+/// @brief Writes the QuadTree to an open stream, see QTC_encoder. The stream
+/// is written sequentially, so it can be a pipe or a memory stream.
+/// @param qt The QuadTree to write.
+/// @param file The stream to write to.
+/// @param indexLevel 0 for no index, otherwise the level of the index.
+/// @param metadata comment lines stored after the header, NULL for none.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise.
+int QTC_encoderStream(QuadTree *qt, FILE *file, unsigned char indexLevel,
+                      const char *metadata, int verbose);
+
+/// @brief Writes the QuadTree in a buffer of the caller, see QTC_encoder. The
+/// buffer is grown with realloc when needed and kept by the caller, so
+/// repeated encodings of images of the same size reuse its memory.
+/// @param qt The QuadTree to write.
+/// @param data The buffer, NULL at first, to free with free. It holds the
+/// file once the function returns 0.
+/// @param capacity The number of bytes the buffer can hold, 0 at first.
+/// @param size The size of the file written in the buffer.
+/// @param indexLevel 0 for no index, otherwise the level of the index.
+/// @param metadata comment lines stored after the header, NULL for none.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise.
+int QTC_encoderBuffer(QuadTree *qt, unsigned char **data, size_t *capacity,
+                      size_t *size, unsigned char indexLevel,
+                      const char *metadata, int verbose);
+
+/// @brief Writes a SparseQuadTree to a file without an index, e.g. a tree
+/// read by QTC_decoderSparse. Only its stored nodes are read, so an image
+/// made of few blocks is written in little memory, whatever its size.
+/// @param sqt The SparseQuadTree to write.
+/// @param filename The name of the file to write to.
+/// @param metadata comment lines stored after the header, NULL for none.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise.
+int QTC_encoderSparse(SparseQuadTree *sqt, const char *filename,
+                      const char *metadata, int verbose);
+
+/// @brief Writes a frame of a sequence as its changes from the previous one.
+/// The bitstream is written depth first: a bit per node tells if its block
+/// is the same as in the reference, the unchanged subtrees are not stored.
+/// It is preceded by the hashes of the reference and of the decoded frame, so
+/// the decoder rejects a frame read over another reference.
+/// @param qt The QuadTree of the frame, filtered or not. It is reconstructed
+/// (see reconstructQuadTree) to be compared with the reference.
+/// @param ref The reconstructed QuadTree of the previous frame, it becomes
+/// the decoded frame, i.e. the reference of the next one.
+/// @param filename The name of the file to write to.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise.
+int QTC_encoderInter(QuadTree *qt, QuadTree *ref, const char *filename,
+                     int verbose);
 
 /// @brief Filters the QuadTree using variance and uniformity.
-/// @param qt The QuadTree to filter.
+/// @param qt The QuadTree to filter, its statistics must have been computed.
 /// @param alpha The threshold for variance.
 /// @param beta The second threshold for variance.
 /// @param verbose 1 if verbose mode is enabled, 0 otherwise.
 void filterQuadTree(QuadTree *qt, double alpha, double beta, int verbose);
 
+/// @brief Filters the QuadTree like filterQuadTree, recording every changed
+/// node so that the pass can be reverted with undoFilter.
+/// @param qt The QuadTree to filter, its statistics must have been computed.
+/// @param alpha The threshold for variance.
+/// @param beta The second threshold for variance.
+/// @param log The log receiving the changed nodes (zero initialized or
+/// emptied by undoFilter).
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 if the log could not be allocated.
+int filterQuadTreeLogged(QuadTree *qt, double alpha, double beta,
+                         FilterLog *log, int verbose);
+
+/// @brief Reverts the filter pass recorded in the log and empties the log.
+/// @param qt The filtered QuadTree.
+/// @param log The log of the filter pass.
+void undoFilter(QuadTree *qt, FilterLog *log);
+
+/// @brief Frees the memory held by a filter log.
+/// @param log The log to free.
+void freeFilterLog(FilterLog *log);
+
 #endif
\ No newline at end of file
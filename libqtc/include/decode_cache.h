@@ -0,0 +1,64 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#ifndef _DECODE_CACHE_H
+#define _DECODE_CACHE_H
+
+// the counters and the budget are part of the public API
+#include "qtc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Tells if the decode cache is enabled.
+/// @return 1 if its budget is not 0, 0 otherwise.
+int decodeCacheEnabled(void);
+
+/// @brief Hashes the content of an encoded file, it selects the entries of
+/// the cache whose content is then compared.
+/// @param data The content.
+/// @param size The size of the content.
+/// @return The 64-bit hash.
+uint64_t hashContent(const unsigned char *data, size_t size);
+
+/// @brief Decoded image, whose pixmap and comments are owned by the image or
+/// lent by an entry of the cache. A lent pixmap must not be modified.
+typedef struct {
+  unsigned char *pixmap;   // pixels of the image, to free with the image
+  size_t width;            // width of the pixmap
+  unsigned char grayScale; // grayscale of the image
+  char *comments;          // comments of the image, NULL if there are none
+  struct Entry *entry;     // entry lending the pixmap, NULL if owned
+} DecodedImage;
+
+/// @brief Lends a cached pixmap, nothing is copied: the entry is kept until
+/// the image is released, even if it is evicted meanwhile. The entry becomes
+/// the most recently used. An entry is only a hit if its encoded content is
+/// the same.
+/// @param hash The hash of the encoded content.
+/// @param content The encoded content.
+/// @param size The size of the encoded content.
+/// @param image The image borrowing the entry, to free with
+/// releaseDecodedImage.
+/// @return 0 on a hit, -1 on a miss.
+int acquireDecodeCache(uint64_t hash, const unsigned char *content,
+                       size_t size, DecodedImage *image);
+
+/// @brief Hands the pixmap and the comments of an image over to the cache, if
+/// they fit in the budget, with a copy of its encoded content. The image then
+/// borrows them from the new entry, otherwise it keeps them.
+/// @param hash The hash of the encoded content.
+/// @param content The encoded content.
+/// @param size The size of the encoded content.
+/// @param image The decoded image, owning its pixmap.
+void storeDecodeCache(uint64_t hash, const unsigned char *content,
+                      size_t size, DecodedImage *image);
+
+/// @brief Frees an image, or gives its pixmap back to the cache.
+/// @param image The image.
+void releaseDecodedImage(DecodedImage *image);
+
+#endif
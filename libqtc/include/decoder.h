@@ -8,21 +8,85 @@
 #define _DECODER_H_
 
 #include "quadtree.h"
+#include "sparse_quadtree.h"
 #include "verbose.h"
 
+#include <stdio.h>
+
 /// @brief Decodes a QuadTree from a file
 /// @param filename The name of the file to read from
 /// @param qt The QuadTree to fill
 /// @param grayScale The grayscale of the image
-/// @param comments The comments of the image
+/// @param comments The comments of the image, NULL to skip them
 /// @param verbose 1 if verbose mode is enabled, 0 otherwise
 /// @return 0 if the QuadTree was read successfully, -1 otherwise
 int QTC_decoder(const char *filename, QuadTree **qt,
                          unsigned char *grayScale, char **comments, int verbose);
 
+/// @brief Decodes a file into a SparseQuadTree, only the nodes stored in the
+/// bitstream are allocated
+/// @param filename The name of the file to read from
+/// @param sqt The SparseQuadTree to create, or to read again if not NULL
+/// @param grayScale The grayscale of the image
+/// @param comments The comments of the image, NULL to skip them
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the SparseQuadTree was read successfully, -1 otherwise
+int QTC_decoderSparse(const char *filename, SparseQuadTree **sqt,
+                      unsigned char *grayScale, char **comments, int verbose);
+
+/// @brief Decodes an open stream into a SparseQuadTree, see QTC_decoderSparse
+/// @param file The stream to read from, positioned at the magic number
+/// @param sqt The SparseQuadTree to create, or to read again if not NULL
+/// @param grayScale The grayscale of the image
+/// @param comments The comments of the image, NULL to skip them
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the SparseQuadTree was read successfully, -1 otherwise
+int QTC_decoderSparseStream(FILE *file, SparseQuadTree **sqt,
+                            unsigned char *grayScale, char **comments,
+                            int verbose);
+
+/// @brief Decodes a file held in memory into a SparseQuadTree, see
+/// QTC_decoderSparse. The bits are read straight from the data: given a tree
+/// that already held as many nodes on each level, nothing is allocated
+/// (unless the comments are asked for).
+/// @param data The content of the file
+/// @param size The size of the content
+/// @param sqt The SparseQuadTree to create, or to read again if not NULL
+/// @param grayScale The grayscale of the image
+/// @param comments The comments of the image, NULL to skip them
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the SparseQuadTree was read successfully, -1 otherwise
+int QTC_decoderSparseBuffer(const unsigned char *data, size_t size,
+                            SparseQuadTree **sqt, unsigned char *grayScale,
+                            char **comments, int verbose);
+
+/// @brief Decodes a frame of a sequence over the previous one, only the
+/// changed blocks are read and drawn
+/// @param filename The name of the file to read from
+/// @param ref The QuadTree of the previous frame, as decoded by QTC_decoder
+/// or this function, it becomes the decoded frame
+/// @param pixmap The image of the previous frame, its changed blocks are
+/// drawn, NULL if no image is kept
+/// @param id The identity of the previous frame: hashQuadTree of the first
+/// one, then the value set by this function. A frame coded over another
+/// reference is rejected, otherwise it becomes the identity of the frame.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the frame was read successfully, -1 otherwise (ref and
+/// pixmap are then unchanged)
+int QTC_decoderInter(const char *filename, QuadTree *ref,
+                     unsigned char *pixmap, uint64_t *id, int verbose);
+
+/// @brief Reads the height of the QuadTree from the header of a file held in
+/// memory, without decoding it
+/// @param data The content of the file
+/// @param size The size of the content
+/// @param h The height of the quadtree, the image is 2^h pixels wide
+/// @return 0 if the header is valid, -1 otherwise
+int QTC_readHeight(const unsigned char *data, size_t size, unsigned char *h);
+
 /// @brief Translates the QuadTree into a pixmap
 /// @param qt The QuadTree to translate
-/// @param pixmap The pixmap to fill
+/// @param pixmap The pixmap to allocate and fill, to free with largeFree
 /// @param h The height of the QuadTree
 /// @param verbose 1 if verbose mode is enabled, 0 otherwise
 /// @return 0 if the pixmap was built successfully, -1 otherwise
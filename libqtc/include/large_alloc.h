@@ -0,0 +1,46 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#ifndef _LARGE_ALLOC_H
+#define _LARGE_ALLOC_H
+
+#include <stddef.h>
+
+// allocation modes of the node arrays and pixmaps
+#define ALLOC_DEFAULT 0   // plain malloc
+#define ALLOC_HUGEPAGES 1 // huge pages, falls back to malloc if unavailable
+
+/// @brief Sets the allocation mode of the large buffers. It should be set
+/// once, before any buffer is allocated.
+/// @param mode ALLOC_DEFAULT or ALLOC_HUGEPAGES.
+void setAllocMode(int mode);
+
+/// @brief Allocates a large buffer. In ALLOC_HUGEPAGES mode, buffers of at
+/// least one huge page are mapped with MAP_HUGETLB, or with transparent huge
+/// pages if no huge page is reserved, and with malloc as a last resort.
+/// The pages are only touched by their first write, so they are placed on
+/// the NUMA node of the thread filling them.
+/// @param size The size of the buffer in bytes.
+/// @return The buffer, NULL if the allocation failed.
+void *largeAlloc(size_t size);
+
+/// @brief Allocates a large zeroed buffer, see largeAlloc.
+/// @param count The number of elements.
+/// @param size The size of an element in bytes.
+/// @return The buffer, NULL if the allocation failed.
+void *largeCalloc(size_t count, size_t size);
+
+/// @brief Shrinks a large buffer, its content is kept up to size.
+/// @param ptr The buffer, allocated by largeAlloc or largeCalloc.
+/// @param size The new size of the buffer in bytes.
+/// @return The shrunk buffer, ptr if it could not be moved.
+void *largeShrink(void *ptr, size_t size);
+
+/// @brief Frees a buffer allocated by largeAlloc or largeCalloc.
+/// @param ptr The buffer, may be NULL.
+void largeFree(void *ptr);
+
+#endif
@@ -0,0 +1,26 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <stddef.h>
+
+/// @brief Gives the number of threads to split a work in.
+/// @param maxThreads The number of independent parts of the work.
+/// @return The number of CPUs, at most maxThreads and at least 1.
+size_t parallelThreads(size_t maxThreads);
+
+/// @brief Runs a function on each job of an array, one thread per job. The
+/// last job is run by the current thread, as are the jobs whose thread could
+/// not be created. Returns once every job is done.
+/// @param fn The function, given a pointer to its job.
+/// @param jobs The array of jobs.
+/// @param jobSize The size of a job in bytes.
+/// @param n The number of jobs.
+void runParallel(void *(*fn)(void *), void *jobs, size_t jobSize, size_t n);
+
+#endif
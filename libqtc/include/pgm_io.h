@@ -9,11 +9,13 @@
 
 #include "verbose.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 /// @brief Reads a PGM file and stores the image data in the given image
-/// pointer.
+/// pointer. Binary (P5), plain (P2) and single channel PAM (P7) files are
+/// accepted.
 /// @param filename name of the PGM file to parse.
-/// @param image  pointer to the image data.
+/// @param image  pointer to the image data, to free with largeFree.
 /// @param width  pointer to the width of the image.
 /// @param height pointer to the height of the image.
 /// @param grayScale  Maximum grayscale value.
@@ -22,6 +24,31 @@
 int readPGM(const char *filename, unsigned char **image, size_t *width,
             size_t *height, unsigned char *grayScale, int verbose);
 
+/// @brief Reads a PGM file already loaded in memory, see readPGM.
+/// @param data content of the PGM file.
+/// @param size size of the content.
+/// @param image  pointer to the image data, to free with largeFree.
+/// @param width  pointer to the width of the image.
+/// @param height pointer to the height of the image.
+/// @param grayScale  Maximum grayscale value.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the parsing was successful, -1 otherwise.
+int readPGMMemory(const unsigned char *data, size_t size, unsigned char **image,
+                  size_t *width, size_t *height, unsigned char *grayScale,
+                  int verbose);
+
+/// @brief Reads a PGM file loaded in a buffer of the caller without copying
+/// it, see readPGM: the pixmap is built at the start of the buffer.
+/// @param data content of the PGM file, overwritten by the pixmap.
+/// @param size size of the content.
+/// @param width  pointer to the width of the image.
+/// @param height pointer to the height of the image.
+/// @param grayScale  Maximum grayscale value.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the parsing was successful, -1 otherwise.
+int readPGMInPlace(unsigned char *data, size_t size, size_t *width,
+                   size_t *height, unsigned char *grayScale, int verbose);
+
 /// @brief Writes a PGM file with the given pixmap.
 /// @param filename name of the file to write.
 /// @param pixmap buffer containing the image data.
@@ -33,4 +60,61 @@ int readPGM(const char *filename, unsigned char **image, size_t *width,
 int writePGM(const char *filename, unsigned char *pixmap, size_t width,
              unsigned char grayScale, char *comments, int verbose);
 
+/// @brief Writes a binary PGM image to an open stream.
+/// @param file stream to write to.
+/// @param pixmap buffer containing the image data.
+/// @param width width of the image.
+/// @param grayScale Maximum grayscale value.
+/// @param comments Comments to write in the file.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the writing was successful, -1 otherwise.
+int writePGMStream(FILE *file, unsigned char *pixmap, size_t width,
+                   unsigned char grayScale, char *comments, int verbose);
+
+/// @brief Formats the header of a binary PGM image in memory like snprintf,
+/// the pixels follow it, see writePGMStream.
+/// @param buffer buffer to fill, NULL if size is 0.
+/// @param size size of the buffer, the header is cut to fit.
+/// @param width width of the image.
+/// @param grayScale Maximum grayscale value.
+/// @param comments Comments to write in the header, NULL for none.
+/// @return the size of the whole header, without its terminating null byte.
+size_t formatHeaderPGM(char *buffer, size_t size, size_t width,
+                       unsigned char grayScale, const char *comments);
+
+/// @brief A PGM file whose pixels are mapped in memory.
+typedef struct {
+  void *base;            // start of the mapping, NULL once closed
+  size_t length;         // size of the mapping, i.e. of the file
+  unsigned char *pixmap; // first pixel of the image in the mapping
+  size_t width;          // width of the image
+} MappedPGM;
+
+/// @brief Creates a binary PGM file of its final size and maps its pixels,
+/// so the image can be drawn in place instead of being copied by writePGM.
+/// The space of the file is reserved first, the file is removed on failure.
+/// @param filename name of the file to write.
+/// @param width width of the image.
+/// @param grayScale Maximum grayscale value.
+/// @param comments Comments to write in the file.
+/// @param pgm The mapped file, to close with closeMappedPGM.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the file was mapped, -1 otherwise.
+int openMappedPGM(const char *filename, size_t width, unsigned char grayScale,
+                  char *comments, MappedPGM *pgm, int verbose);
+
+/// @brief Gives back the memory of rows already written in a mapped PGM file,
+/// so drawing a large image band by band keeps few pages resident. Their
+/// pixels are kept by the file and read again if the rows are accessed.
+/// @param pgm The mapped file.
+/// @param firstRow The first row written.
+/// @param lastRow The row after the last one written.
+void releaseMappedRows(MappedPGM *pgm, size_t firstRow, size_t lastRow);
+
+/// @brief Unmaps a PGM file, its pixels are then saved.
+/// @param pgm The mapped file.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise.
+int closeMappedPGM(MappedPGM *pgm, int verbose);
+
 #endif
\ No newline at end of file
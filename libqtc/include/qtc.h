@@ -9,22 +9,455 @@
 
 #include "file_naming.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
+// segmentation outputs, to be combined
+#define SEGMENTATION_GRID 1   // grid image of the blocks (_g.pgm)
+#define SEGMENTATION_BLOCKS 2 // list of the blocks (_g.txt)
+
+// allocation modes of the node arrays and pixmaps
+#define ALLOC_DEFAULT 0   // plain malloc
+#define ALLOC_HUGEPAGES 1 // huge pages, falls back to malloc if unavailable
+
+/// @brief set the allocation mode of the node arrays and pixmaps, to call
+/// before encoding or decoding
+/// @param mode ALLOC_DEFAULT or ALLOC_HUGEPAGES
+void setAllocMode(int mode);
+
+// statistics compared by the filter
+#define VARIANCE_EXACT 0  // standard deviation of the pixels of each block
+#define VARIANCE_LEGACY 1 // recursive approximation of the first versions
+
+/// @brief set the statistics of the blocks compared by the filter, to call
+/// before encoding. The standard deviation of the pixels is derived from exact
+/// integer sums, the legacy mode reproduces the files of the first versions.
+/// @param mode VARIANCE_EXACT (default) or VARIANCE_LEGACY
+void setVarianceMode(int mode);
+
+/// @brief counters of the decode cache
+typedef struct {
+  size_t hits;      // decodes answered by the cache
+  size_t misses;    // decodes that went through the decoder
+  size_t evictions; // entries removed to stay within the budget
+  size_t entries;   // number of cached pixmaps
+  size_t bytes;     // memory used by the cached pixmaps
+  size_t budget;    // maximum memory of the cache, 0 if it is disabled
+} DecodeCacheStats;
+
+/// @brief set the memory budget of the decode cache. While it is enabled, a
+/// .qtc content decoded before (same bytes) is read from the cache instead
+/// of being decoded again, the least recently used pixmaps are evicted to stay
+/// within the budget. Decodes with a segmentation always use the decoder.
+/// @param budget budget in bytes, 0 (the default) disables and empties the
+/// cache
+void setDecodeCacheBudget(size_t budget);
+
+/// @brief read the counters of the decode cache
+/// @param stats counters to fill
+void getDecodeCacheStats(DecodeCacheStats *stats);
+
+/// @brief empty the decode cache, its budget and counters are kept
+void clearDecodeCache(void);
+
 /// @brief encode image input .pgm in output
 /// @param input name of file to encode .pgm
 /// @param output name of output file
 /// @param alpha alpha value
 /// @param beta beta value
-/// @param segmentation if 0, no segmentation grid; if 1, segmentation is applied.
+/// @param lossless if 1, no filtering is done and alpha/beta are ignored.
+/// @param indexLevel if not 0, level of the subtree index written in the
+/// file (at most 8), the subtrees can then be decoded in parallel.
+/// @param segmentation 0 for no segmentation, otherwise a combination of
+/// SEGMENTATION_GRID and SEGMENTATION_BLOCKS.
 /// @param verbose 1 if verbose mode is enabled, 0 otherwise.
 /// @return 0 if the encoding was successful, -1 otherwise.
-int encodeImage(const char *input, char *output, double alpha, double beta, int flag_g, int verbose, int flag_o);
+int encodeImage(const char *input, char *output, double alpha, double beta, int lossless, int indexLevel, int flag_g, int verbose, int flag_o);
 
 /// @brief decode image .qtc in output
 /// @param input name of file to decode .qtc
 /// @param output name of output file
-/// @param segmentation if 0, no segmentation grid; if 1, segmentation is applied.
+/// @param segmentation 0 for no segmentation, otherwise a combination of
+/// SEGMENTATION_GRID and SEGMENTATION_BLOCKS.
 /// @param verbose 1 if verbose mode is enabled, 0 otherwise.
 /// @return 0 if the decode was successful, -1 otherwise.
 int decodeImage(const char *input, char *output, int segmentation, int verbose, int flag_o);
 
+/// @brief write a lower quality version of a .qtc file. The tree is decoded,
+/// its variances are computed from the decoded means and it is filtered again
+/// with alpha and beta, no pixmap is built.
+/// @param input name of the .qtc file
+/// @param output name of output file
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param indexLevel if not 0, level of the subtree index written in the
+/// file.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @param flag_o 1 if output file is specified, 0 otherwise.
+/// @return 0 if the requantization was successful, -1 otherwise.
+int requantizeImage(const char *input, char *output, double alpha,
+                    double beta, int indexLevel, int verbose, int flag_o);
+
+// geometric transforms, applied to the tree without going through pixels
+#define TRANSFORM_FLIP_H 0  // mirror left to right
+#define TRANSFORM_FLIP_V 1  // mirror top to bottom
+#define TRANSFORM_ROT90 2   // quarter turn clockwise
+#define TRANSFORM_ROT180 3  // half turn
+#define TRANSFORM_ROT270 4  // quarter turn counterclockwise
+#define TRANSFORM_CROP_TL 5 // top left quadrant
+#define TRANSFORM_CROP_TR 6 // top right quadrant
+#define TRANSFORM_CROP_BR 7 // bottom right quadrant
+#define TRANSFORM_CROP_BL 8 // bottom left quadrant
+
+/// @brief write a flipped, rotated or cropped copy of a .qtc file. The
+/// children of the decoded tree are reordered, or the subtree of a quadrant
+/// is kept, so no pixmap is built and nothing is lost.
+/// @param input name of the .qtc file
+/// @param output name of output file
+/// @param op one of the TRANSFORM_* operations
+/// @param indexLevel if not 0, level of the subtree index written in the
+/// file.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @param flag_o 1 if output file is specified, 0 otherwise.
+/// @return 0 if the transform was successful, -1 otherwise.
+int transformImage(const char *input, char *output, int op, int indexLevel,
+                   int verbose, int flag_o);
+
+/// @brief write the parent tile of four .qtc tiles of the same size, as in
+/// a pyramid: the four trees become the children of a new root, cut to their
+/// height so that each pixel is the mean of 2x2 pixels, then filtered again.
+/// No pixmap is built.
+/// @param inputs names of the four .qtc files, row by row: top left, top
+/// right, bottom left, bottom right
+/// @param output name of output file
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param lossless if 1, no filtering is done and alpha/beta are ignored.
+/// @param indexLevel if not 0, level of the subtree index written in the
+/// file.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @param flag_o 1 if output file is specified, 0 otherwise.
+/// @return 0 if the merge was successful, -1 otherwise.
+int mergeImages(char **inputs, char *output, double alpha, double beta,
+                int lossless, int indexLevel, int verbose, int flag_o);
+
+/// @brief write every level of a pyramid above its leaf tiles, each tile
+/// merged from the four below it like mergeImages. The tile at the row r and
+/// column c of the level l (0 for the top tile) is written in
+/// QTC/<output>_<l>_<r>_<c>.qtc. The levels are merged before filtering, so
+/// the losses do not add up, and the grid is split between the CPUs.
+/// @param tiles names of the .qtc leaf tiles, row by row, all of the same
+/// size
+/// @param gridWidth number of leaf tiles per side, a power of two (at least
+/// 2)
+/// @param output prefix of the names of the written tiles
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param lossless if 1, no filtering is done and alpha/beta are ignored.
+/// @param indexLevel if not 0, level of the subtree index written in the
+/// files.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the pyramid was built, -1 otherwise.
+int buildPyramid(char **tiles, size_t gridWidth, char *output, double alpha,
+                 double beta, int lossless, int indexLevel, int verbose);
+
+/// @brief load a whole file in memory, e.g. to give it to decodeMemory
+/// @param filename name of the file
+/// @param size size of the file
+/// @return the content of the file, to free with free, NULL if it could not
+/// be read
+unsigned char *loadFile(const char *filename, size_t *size);
+
+/// @brief encode a PGM file held in memory, nothing is written on disk
+/// @param pgm content of the PGM file
+/// @param pgmSize size of the content
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param lossless if 1, no filtering is done and alpha/beta are ignored.
+/// @param indexLevel if not 0, level of the subtree index.
+/// @param qtc content of the encoded .qtc file, to free with free
+/// @param qtcSize size of the encoded content
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the encoding was successful, -1 otherwise.
+int encodeMemory(const unsigned char *pgm, size_t pgmSize, double alpha,
+                 double beta, int lossless, int indexLevel, unsigned char **qtc,
+                 size_t *qtcSize, int verbose);
+
+/// @brief decode a .qtc file held in memory, nothing is written on disk
+/// @param qtc content of the .qtc file
+/// @param qtcSize size of the content
+/// @param pgm content of the decoded PGM file, to free with free
+/// @param pgmSize size of the decoded content
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the decode was successful, -1 otherwise.
+int decodeMemory(const unsigned char *qtc, size_t qtcSize, unsigned char **pgm,
+                 size_t *pgmSize, int verbose);
+
+/// @brief buffers kept by a caller of encodeMemoryBuffered and
+/// decodeMemoryBuffered from one call to the next, e.g. a worker of a server:
+/// the trees and the answer are reused instead of being allocated again
+typedef struct CodecBuffers CodecBuffers;
+
+/// @brief create empty buffers for the memory entry points
+/// @return the buffers, to free with freeCodecBuffers, NULL on failure
+CodecBuffers *createCodecBuffers(void);
+
+/// @brief free buffers created by createCodecBuffers
+/// @param buffers the buffers, may be NULL
+void freeCodecBuffers(CodecBuffers *buffers);
+
+/// @brief encode a PGM file held in memory like encodeMemory, the pixmap is
+/// built over the content and the tree and the answer are kept in buffers.
+/// @param buffers buffers created by createCodecBuffers
+/// @param pgm content of the PGM file, overwritten
+/// @param pgmSize size of the content
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param lossless if 1, no filtering is done and alpha/beta are ignored.
+/// @param indexLevel if not 0, level of the subtree index.
+/// @param qtc content of the encoded .qtc file, held by buffers until their
+/// next use
+/// @param qtcSize size of the encoded content
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the encoding was successful, -1 otherwise.
+int encodeMemoryBuffered(CodecBuffers *buffers, unsigned char *pgm,
+                         size_t pgmSize, double alpha, double beta,
+                         int lossless, int indexLevel,
+                         const unsigned char **qtc, size_t *qtcSize,
+                         int verbose);
+
+/// @brief decode a .qtc file held in memory like decodeMemory, the tree and
+/// the answer are kept in buffers: the image is drawn straight in the answer.
+/// @param buffers buffers created by createCodecBuffers
+/// @param qtc content of the .qtc file
+/// @param qtcSize size of the content
+/// @param pgm content of the decoded PGM file, held by buffers until their
+/// next use
+/// @param pgmSize size of the decoded content
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the decode was successful, -1 otherwise.
+int decodeMemoryBuffered(CodecBuffers *buffers, const unsigned char *qtc,
+                         size_t qtcSize, const unsigned char **pgm,
+                         size_t *pgmSize, int verbose);
+
+/// @brief decoded tree of a .qtc file, kept by the caller to decode several
+/// tiles without allocating
+typedef struct SparseQuadTree SparseQuadTree;
+
+/// @brief create an empty decoded tree for decodeIntoTree
+/// @return the tree, to free with freeDecodeTree, NULL on failure
+SparseQuadTree *createDecodeTree(void);
+
+/// @brief free a tree created by createDecodeTree
+/// @param sqt the tree, may be NULL
+void freeDecodeTree(SparseQuadTree *sqt);
+
+/// @brief decode the tree of a .qtc file once for the queries below
+/// (regionMean, imageHistogram, imageMinMax), only the stored nodes are
+/// allocated and the comments are skipped. The tree of the last
+/// decodeIntoTree can be queried as well.
+/// @param input name of the .qtc file
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return the tree, to free with freeDecodeTree, NULL if the file could not
+/// be parsed
+SparseQuadTree *loadDecodeTree(const char *input, int verbose);
+
+/// @brief write a decoded tree back to a .qtc file, without index nor
+/// comments. Only its stored nodes are read, so a large image made of few
+/// blocks is encoded without building its pixmap nor its full tree.
+/// @param sqt tree holding a decoded image
+/// @param output name of the .qtc file
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 if the file could not be written.
+int saveDecodeTree(SparseQuadTree *sqt, const char *output, int verbose);
+
+/// @brief mean of the pixels of a region of a decoded tree, computed from
+/// its blocks weighted by their area, no pixmap is built.
+/// @param sqt tree holding a decoded image
+/// @param x column of the top left pixel of the region
+/// @param y row of the top left pixel of the region
+/// @param w width of the region, inside the image
+/// @param h height of the region, inside the image
+/// @param mean the mean of the region
+/// @return 0 if successful, -1 if the region is not inside the image.
+int regionMean(SparseQuadTree *sqt, size_t x, size_t y, size_t w, size_t h,
+               double *mean);
+
+/// @brief number of pixels of each value of a decoded tree, computed from
+/// its blocks weighted by their area, no pixmap is built.
+/// @param sqt tree holding a decoded image
+/// @param histogram the number of pixels of each value
+void imageHistogram(SparseQuadTree *sqt, size_t histogram[256]);
+
+/// @brief lowest and highest pixel values of a decoded tree, computed from
+/// its blocks, no pixmap is built.
+/// @param sqt tree holding a decoded image
+/// @param min the lowest value
+/// @param max the highest value
+void imageMinMax(SparseQuadTree *sqt, unsigned char *min, unsigned char *max);
+
+/// @brief decode a .qtc file held in memory straight into an image of the
+/// caller, e.g. to compose several tiles in one canvas. The bits are read
+/// straight from qtc, the pixels are drawn in place and the tree is read in
+/// the one given, whose memory is kept for the next tiles: nothing is
+/// allocated once it has held tiles with as many nodes on each level. The
+/// fit is checked from the header, before decoding.
+/// @param qtc content of the .qtc file
+/// @param qtcSize size of the content
+/// @param sqt tree created by createDecodeTree
+/// @param canvas first row of the canvas
+/// @param canvasWidth width of the canvas in pixels
+/// @param canvasHeight height of the canvas in pixels
+/// @param stride number of bytes from a row of the canvas to the next, at
+/// least canvasWidth
+/// @param x0 column of the top left pixel of the image in the canvas
+/// @param y0 row of the top left pixel of the image in the canvas
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the decode was successful, -1 if the data could not be
+/// decoded or the image does not fit in the canvas.
+int decodeIntoTree(const unsigned char *qtc, size_t qtcSize,
+                   SparseQuadTree *sqt, unsigned char *canvas,
+                   size_t canvasWidth, size_t canvasHeight, size_t stride,
+                   size_t x0, size_t y0, int verbose);
+
+/// @brief decode a .qtc file held in memory straight into an image of the
+/// caller like decodeIntoTree, with a tree allocated for this tile only.
+/// @param qtc content of the .qtc file
+/// @param qtcSize size of the content
+/// @param canvas first row of the canvas
+/// @param canvasWidth width of the canvas in pixels
+/// @param canvasHeight height of the canvas in pixels
+/// @param stride number of bytes from a row of the canvas to the next, at
+/// least canvasWidth
+/// @param x0 column of the top left pixel of the image in the canvas
+/// @param y0 row of the top left pixel of the image in the canvas
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the decode was successful, -1 if the data could not be
+/// decoded or the image does not fit in the canvas.
+int decodeInto(const unsigned char *qtc, size_t qtcSize, unsigned char *canvas,
+               size_t canvasWidth, size_t canvasHeight, size_t stride,
+               size_t x0, size_t y0, int verbose);
+
+#define PACK_NAME_SIZE 44
+
+/// @brief Entry of the index of a pack, stored in 64 bytes in little endian
+typedef struct {
+  uint64_t offset;           // position of the .qtc content in the pack
+  uint64_t size;             // size of the .qtc content
+  uint32_t width;            // width of the image in pixels
+  char name[PACK_NAME_SIZE]; // name of the entry, ended by '\0'
+} PackEntry;
+
+/// @brief Pack mapped in memory, with its index read in entries
+typedef struct {
+  const unsigned char *base; // start of the mapping
+  size_t length;             // size of the mapping
+  PackEntry *entries;        // index of the pack
+  size_t count;              // number of entries
+} PackFile;
+
+/// @brief store .qtc files in a single pack, one after the other, followed
+/// by an index of their names, positions and widths. If the pack exists, the
+/// files are appended to it.
+/// @param pack name of the pack
+/// @param inputs names of the .qtc files, an entry is named after its file
+/// without directory and extension
+/// @param count number of files
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise (the pack then keeps its previous
+/// entries).
+int packFiles(const char *pack, char **inputs, size_t count, int verbose);
+
+/// @brief map a pack in memory and check its index
+/// @param pack name of the pack
+/// @param packFile the mapped pack, to close with closePack
+/// @return 0 if successful, -1 otherwise.
+int openPack(const char *pack, PackFile *packFile);
+
+/// @brief unmap a pack opened with openPack
+/// @param packFile the mapped pack
+void closePack(PackFile *packFile);
+
+/// @brief find an entry of a pack by name
+/// @param packFile the mapped pack
+/// @param name name of the entry
+/// @param id position of the entry in the index, the last one if several
+/// entries have this name
+/// @return 0 if found, -1 otherwise.
+int findPackEntry(const PackFile *packFile, const char *name, size_t *id);
+
+/// @brief decode an entry of a pack, its content is read from the mapping
+/// without any copy
+/// @param packFile the mapped pack
+/// @param id position of the entry in the index
+/// @param pgm content of the decoded PGM file, to free with free
+/// @param pgmSize size of the decoded content
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the decode was successful, -1 otherwise.
+int decodePackEntry(const PackFile *packFile, size_t id, unsigned char **pgm,
+                    size_t *pgmSize, int verbose);
+
+/// @brief extract every entry of a pack in QTC/<name>.qtc, or decode them in
+/// PGM/<name>.pgm
+/// @param pack name of the pack
+/// @param decode if 1, the entries are decoded
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise.
+int unpackFiles(const char *pack, int decode, int verbose);
+
+/// @brief Result of one parameter pair of a sweep.
+typedef struct {
+  double alpha;
+  double beta;
+  size_t size; // size of the encoded tree in bytes
+  double psnr; // PSNR of the decoded image in dB (INFINITY if lossless)
+} SweepResult;
+
+/// @brief encode image input .pgm with several (alpha, beta) pairs, the
+/// QuadTree is built once and each pair only costs a filter pass.
+/// @param input name of file to encode .pgm
+/// @param output name of output file
+/// @param alpha alpha values
+/// @param beta beta values
+/// @param count number of (alpha, beta) pairs
+/// @param results size and PSNR of each pair
+/// @param best index of the smallest result with a PSNR >= minPSNR, -1 if none
+/// @param minPSNR minimum PSNR of the best result, if negative nothing is
+/// written, otherwise the best result is written in output.
+/// @param indexLevel level of the subtree index of the written file, 0 for
+/// none.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @param flag_o 1 if output file is specified, 0 otherwise.
+/// @return 0 if the sweep was successful, -1 otherwise.
+int sweepImage(const char *input, char *output, const double *alpha,
+               const double *beta, size_t count, SweepResult *results,
+               int *best, double minPSNR, int indexLevel, int verbose,
+               int flag_o);
+
+/// @brief encode a sequence of images of the same size, each one in
+/// QTC/<output>_<k>.qtc. The first frame is an ordinary .qtc file, each next
+/// one only stores the blocks that changed since the previous frame, so a
+/// still image costs a few bytes.
+/// @param inputs names of the .pgm frames, in order
+/// @param count number of frames
+/// @param output prefix of the names of the written files
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param lossless if 1, no filtering is done and alpha/beta are ignored.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the sequence was encoded, -1 otherwise.
+int encodeSequence(char **inputs, size_t count, char *output, double alpha,
+                   double beta, int lossless, int verbose);
+
+/// @brief decode a sequence written by encodeSequence, each frame in
+/// PGM/<output>_<k>.pgm. Only the changed blocks of a frame are read and
+/// drawn over the previous one, a frame coded over another one is rejected.
+/// @param inputs names of the .qtc frames, in order, the first one being an
+/// ordinary .qtc file
+/// @param count number of frames
+/// @param output prefix of the names of the written files
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the sequence was decoded, -1 otherwise.
+int decodeSequence(char **inputs, size_t count, char *output, int verbose);
+
 #endif 
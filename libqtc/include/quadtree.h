@@ -8,28 +8,77 @@
 #define _QUADTREE_H
 #include "verbose.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 
+// maximum number of levels, so that totalNodes fits in a size_t
+#define QT_MAX_LEVELS 30
+
+// index of the first node of the level d, a constant expression when d is
+#define LEVEL_START(d) ((((size_t)1 << (2 * (d))) - 1) / 3)
+
 typedef struct {
-  double v;            // variance
   unsigned char m;     // average intesity of the children
   unsigned char u : 1; // uniformity bit
   unsigned char e : 2; // error bit
 } Node;
 
+// statistics of the nodes compared by the filter
+#define VARIANCE_EXACT 0  // standard deviation of the pixels of each block
+#define VARIANCE_LEGACY 1 // recursive approximation of the first versions
+
 typedef struct {
   Node *root;
+  // sums of the pixels and of their squares of each node above the last two
+  // levels, NULL unless the statistics are VARIANCE_EXACT
+  uint64_t *sum;
+  uint64_t *sumSq;
+  double *v; // variance of each node, NULL unless VARIANCE_LEGACY
   unsigned char numLevels;
 } QuadTree;
 
+/// @brief Sets the statistics computed by fillQuadTree and
+/// computeStatistics, VARIANCE_EXACT by default.
+/// @param mode VARIANCE_EXACT or VARIANCE_LEGACY, which reproduces the
+/// filter decisions of the first versions.
+void setVarianceMode(int mode);
+
+/// @brief Gives the sums of the pixels and of their squares of a node above
+/// the leaves. They are only stored above the last two levels, the nodes just
+/// above the leaves (3/4 of them) add up their four leaves instead.
+/// @param qt The QuadTree, with its moments.
+/// @param index The index of the node.
+/// @param sum The sum of the pixels.
+/// @param sumSq The sum of the squared pixels.
+static inline void nodeMoments(const QuadTree *qt, size_t index, uint64_t *sum,
+                               uint64_t *sumSq) {
+  if (index < LEVEL_START(qt->numLevels - 1)) {
+    *sum = qt->sum[index];
+    *sumSq = qt->sumSq[index];
+    return;
+  }
+  const Node *leaf = &qt->root[4 * index + 1];
+  uint64_t m0 = leaf[0].m, m1 = leaf[1].m, m2 = leaf[2].m, m3 = leaf[3].m;
+  *sum = m0 + m1 + m2 + m3;
+  *sumSq = m0 * m0 + m1 * m1 + m2 * m2 + m3 * m3;
+}
+
 /// @brief Calculates the total number of nodes in a quadtree  with h levels.
 /// @param h The number of levels
 /// @return The total number of nodes
 size_t totalNodes(unsigned char h);
 
+/// @brief Calculates the index of the first descendant of a node at a given
+/// depth below it, its descendants at this depth are the 4^depth consecutive
+/// nodes starting there.
+/// @param index The index of the node.
+/// @param depth The depth below the node.
+/// @return The index of the first descendant.
+size_t firstDescendant(size_t index, unsigned char depth);
+
 /// @brief Creates a QuadTree
 /// @param width  The width of the pixmap (since the pixmap is a square no need
-/// for the height)
+/// for the height), a power of two with at most QT_MAX_LEVELS levels
 /// @param verbose 1 if verbose mode is enabled, 0 otherwise
 /// @return A pointer to the created QuadTree.
 QuadTree *createQuadTree(size_t width, int verbose);
@@ -39,9 +88,52 @@ QuadTree *createQuadTree(size_t width, int verbose);
 /// @param pixmap The pixmap to use.
 /// @param width The width of the pixmap (since the pixmap is a square no need
 /// for the height).
+/// @param lossless 1 to only compute the means, errors and uniformity bits,
+/// 0 to also compute the statistics needed by the filter.
 /// @param verbose 1 if verbose mode is enabled, 0 otherwise
-void fillQuadTree(QuadTree *qt, unsigned char *pixmap, size_t width,
-                  int verbose);
+/// @return 0 if successful, -1 if the variances could not be allocated.
+int fillQuadTree(QuadTree *qt, unsigned char *pixmap, size_t width,
+                 int lossless, int verbose);
+
+/// @brief Computes the statistics needed by the filter from the means of the
+/// nodes, the moments or the variances depending on the variance mode. It
+/// also works on a decoded QuadTree, whose pixmap is not available.
+/// @param qt The QuadTree, every node must be set.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if successful, -1 if the statistics could not be allocated.
+int computeStatistics(QuadTree *qt, int verbose);
+
+/// @brief Builds the parent of four QuadTrees of the same size, e.g. a tile
+/// of the level above in a pyramid. The four trees become the children of a
+/// new root and the result is cut to their height, so each leaf is the mean
+/// of 2x2 pixels. The statistics of the filter are not computed.
+/// @param children The QuadTrees in the order of the children: top left, top
+/// right, bottom right, bottom left. Every node must be set.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return The merged QuadTree, NULL if the sizes differ or on failure.
+QuadTree *mergeQuadTrees(QuadTree *children[4], int verbose);
+
+/// @brief Sets a node and all its descendants to a uniform intensity. The
+/// descendants of each level are consecutive.
+/// @param qt The QuadTree.
+/// @param index The index of the node.
+/// @param level The level of the node.
+/// @param m The intensity.
+void fillUniform(QuadTree *qt, size_t index, unsigned char level,
+                 unsigned char m);
+
+/// @brief Sets the descendants of the uniform nodes as the decoder does: they
+/// take the intensity of the node and are uniform with an error of 0. The
+/// tree then holds the decoded image, e.g. the reference of the next frame of
+/// a sequence.
+/// @param qt The QuadTree, every node must be set.
+void reconstructQuadTree(QuadTree *qt);
+
+/// @brief Hashes the image held by a reconstructed QuadTree, the intensities
+/// of its leaves. It identifies the frames of a sequence.
+/// @param qt The QuadTree, reconstructed (see reconstructQuadTree).
+/// @return The 64-bit hash.
+uint64_t hashQuadTree(const QuadTree *qt);
 
 /// @brief Frees the memory allocated for the QuadTree.
 /// @param qt The QuadTree to free.
@@ -1,7 +1,7 @@
 /*===========================================
   Authors:     Ghiles Maloum - Lucas Benesby
   Created:     09/11/2024
-  Modified:    20/11/2024
+  Modified:    19/10/2026
   =========================================== */
 
 #ifndef _SEGMENTATION_H
@@ -9,10 +9,52 @@
 
 #include "quadtree.h"
 
+/// @brief A block of the segmentation: a uniform node of the QuadTree that
+/// has no uniform ancestor.
+typedef struct {
+  size_t x;        // column of the top left pixel
+  size_t y;        // row of the top left pixel
+  size_t size;     // width (and height) of the block
+  unsigned char m; // intensity of the block
+} Block;
 
-/// @brief Transform the QuadTree into a frid of white squares with black
-/// contours, this is used for the segmentation of the image
-/// @param qt The QuadTree to be changed
-void make_contoured_white_squares(QuadTree *qt);
+/// @brief Draws the segmentation grid of the QuadTree: every block is white
+/// with a black upper and left outline. The QuadTree is not modified.
+/// @param qt The QuadTree to draw
+/// @param pixmap The pixmap to allocate and fill, to free with largeFree
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the pixmap was built successfully, -1 otherwise
+int buildSegmentationPixMap(QuadTree *qt, unsigned char **pixmap, int verbose);
 
-#endif
\ No newline at end of file
+/// @brief Draws the segmentation grid of a list of blocks: every block is
+/// white with a black upper and left outline.
+/// @param blocks The blocks covering the image
+/// @param count The number of blocks
+/// @param width The width of the image
+/// @param pixmap The pixmap to allocate and fill, to free with largeFree
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the pixmap was built successfully, -1 otherwise
+int drawSegmentationBlocks(Block *blocks, size_t count, size_t width,
+                           unsigned char **pixmap, int verbose);
+
+/// @brief Lists the blocks of the segmentation in the order of the QuadTree
+/// (TL, TR, BR, BL).
+/// @param qt The QuadTree to segment
+/// @param blocks The array of blocks to allocate and fill
+/// @param count The number of blocks
+/// @return 0 if the blocks were listed successfully, -1 otherwise
+int listSegmentationBlocks(QuadTree *qt, Block **blocks, size_t *count);
+
+/// @brief Writes the blocks of the segmentation in a text file, the first
+/// line holds the width of the image and the number of blocks, then each
+/// line holds the x, y, size and intensity of a block.
+/// @param filename The name of the file to write to
+/// @param blocks The blocks to write
+/// @param count The number of blocks
+/// @param width The width of the image
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the writing was successful, -1 otherwise
+int writeSegmentationBlocks(const char *filename, Block *blocks, size_t count,
+                            size_t width, int verbose);
+
+#endif
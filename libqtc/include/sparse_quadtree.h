@@ -0,0 +1,156 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#ifndef _SPARSE_QUADTREE_H
+#define _SPARSE_QUADTREE_H
+
+#include "quadtree.h"
+#include "segmentation.h"
+
+#include <stdint.h>
+
+/// @brief The nodes of one level of a SparseQuadTree. Only the nodes whose
+/// ancestors all have their children stored are present, in breadth-first
+/// order. The children of the i-th expanded node of a level are the nodes
+/// 4i to 4i + 3 of the next level.
+typedef struct {
+  Node *nodes;        // present nodes of the level
+  size_t count;       // number of present nodes
+  size_t capacity;    // number of nodes the array can hold
+  uint64_t *expanded; // bit i is set if the children of nodes[i] are present
+  size_t *rank;       // number of bits set in expanded before each word
+  size_t words;       // number of words expanded and rank can hold
+} SparseLevel;
+
+/// @brief QuadTree storing only the nodes present in the bitstream, without
+/// pointers: the children of a node are found by ranking the expanded bits.
+typedef struct SparseQuadTree {
+  SparseLevel *levels; // levels 0 to numLevels
+  unsigned char numLevels;
+  unsigned char maxLevels; // levels allocated, numLevels or more if reused
+  unsigned char reused;    // 1 if the arrays are kept for the next tree
+} SparseQuadTree;
+
+/// @brief Creates an empty SparseQuadTree.
+/// @param numLevels The number of levels below the root.
+/// @return A pointer to the created SparseQuadTree, NULL on failure.
+SparseQuadTree *createSparseQuadTree(unsigned char numLevels);
+
+/// @brief Empties a SparseQuadTree to read another tree in it. The arrays of
+/// the levels are kept, so a tree with no more nodes on each level than the
+/// previous ones is read without allocating.
+/// @param sqt The SparseQuadTree.
+/// @param numLevels The number of levels below the root of the next tree.
+/// @return 0 if successful, -1 if the levels could not grow.
+int resetSparseQuadTree(SparseQuadTree *sqt, unsigned char numLevels);
+
+/// @brief Appends a node at the end of a level.
+/// @param sqt The SparseQuadTree.
+/// @param level The level of the node.
+/// @param node The node to append.
+/// @return 0 if successful, -1 if the level could not grow.
+int appendSparseNode(SparseQuadTree *sqt, unsigned char level, Node node);
+
+/// @brief Appends the four children of a node at the end of a level.
+/// @param sqt The SparseQuadTree.
+/// @param level The level of the children.
+/// @param group The four children, in order.
+/// @return 0 if successful, -1 if the level could not grow.
+int appendSparseGroup(SparseQuadTree *sqt, unsigned char level,
+                      const Node group[4]);
+
+/// @brief Builds the expanded bitmaps and their rank directories once all the
+/// nodes are appended. A node is expanded if it is neither a leaf nor uniform.
+/// @param sqt The SparseQuadTree.
+/// @return 0 if successful, -1 if the bitmaps could not be allocated.
+int finalizeSparseQuadTree(SparseQuadTree *sqt);
+
+/// @brief Gives the position of the first child of an expanded node.
+/// @param sqt The finalized SparseQuadTree.
+/// @param level The level of the node.
+/// @param pos The position of the node in its level.
+/// @return The position of its first child in the next level.
+size_t sparseFirstChild(SparseQuadTree *sqt, unsigned char level, size_t pos);
+
+/// @brief Counts the nodes stored in the SparseQuadTree.
+/// @param sqt The SparseQuadTree.
+/// @return The number of nodes.
+size_t sparseNodeCount(SparseQuadTree *sqt);
+
+/// @brief Draws the SparseQuadTree into a buffer of the caller, e.g. a
+/// larger image, nothing is allocated.
+/// @param sqt The finalized SparseQuadTree.
+/// @param buffer The position of the top left pixel of the image in the
+/// buffer, the 2^numLevels rows from there must be writable.
+/// @param stride The number of bytes from a row of the buffer to the next.
+void drawSparseQuadTree(SparseQuadTree *sqt, unsigned char *buffer,
+                        size_t stride);
+
+/// @brief Draws the SparseQuadTree like drawSparseQuadTree, large images are
+/// split in bands of rows drawn by one thread per CPU.
+/// @param sqt The finalized SparseQuadTree.
+/// @param buffer The position of the top left pixel of the image in the
+/// buffer, the 2^numLevels rows from there must be writable.
+/// @param stride The number of bytes from a row of the buffer to the next.
+void drawSparseQuadTreeParallel(SparseQuadTree *sqt, unsigned char *buffer,
+                                size_t stride);
+
+/// @brief Draws the rows [firstRow, lastRow) of the SparseQuadTree like
+/// drawSparseQuadTreeParallel, the other rows of the buffer are untouched.
+/// @param sqt The finalized SparseQuadTree.
+/// @param buffer The position of the top left pixel of the image in the
+/// buffer, the rows drawn must be writable.
+/// @param stride The number of bytes from a row of the buffer to the next.
+/// @param firstRow The first row to draw.
+/// @param lastRow The row after the last one to draw, 2^numLevels at most.
+void drawSparseRowsParallel(SparseQuadTree *sqt, unsigned char *buffer,
+                            size_t stride, size_t firstRow, size_t lastRow);
+
+/// @brief Translates the SparseQuadTree into a pixmap.
+/// @param sqt The finalized SparseQuadTree.
+/// @param pixmap The pixmap to allocate and fill, to free with largeFree.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the pixmap was built successfully, -1 otherwise.
+int buildPixMapSparse(SparseQuadTree *sqt, unsigned char **pixmap,
+                      int verbose);
+
+/// @brief Lists the blocks of the segmentation of the SparseQuadTree, in the
+/// same order as listSegmentationBlocks.
+/// @param sqt The finalized SparseQuadTree.
+/// @param blocks The array of blocks to allocate and fill.
+/// @param count The number of blocks.
+/// @return 0 if the blocks were listed successfully, -1 otherwise.
+int listSparseBlocks(SparseQuadTree *sqt, Block **blocks, size_t *count);
+
+/// @brief Adds up the pixels of a region from the blocks it covers, each
+/// block counts for its value times the area it shares with the region. Only
+/// the nodes whose region meets it are visited.
+/// @param sqt The finalized SparseQuadTree.
+/// @param x The column of the top left pixel of the region.
+/// @param y The row of the top left pixel of the region.
+/// @param w The width of the region, inside the image.
+/// @param h The height of the region, inside the image.
+/// @return The sum of the pixels of the region.
+uint64_t sparseRegionSum(SparseQuadTree *sqt, size_t x, size_t y, size_t w,
+                         size_t h);
+
+/// @brief Counts the pixels of each value from the area of the blocks.
+/// @param sqt The finalized SparseQuadTree.
+/// @param histogram The number of pixels of each value.
+void sparseHistogram(SparseQuadTree *sqt, size_t histogram[256]);
+
+/// @brief Gives the lowest and highest values of the blocks.
+/// @param sqt The finalized SparseQuadTree.
+/// @param min The lowest pixel value.
+/// @param max The highest pixel value.
+void sparseMinMax(SparseQuadTree *sqt, unsigned char *min,
+                  unsigned char *max);
+
+/// @brief Frees the memory allocated for the SparseQuadTree.
+/// @param sqt The SparseQuadTree to free.
+void freeSparseQuadTree(SparseQuadTree *sqt);
+
+#endif
@@ -0,0 +1,32 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#ifndef _TRANSFORM_H
+#define _TRANSFORM_H
+
+#include "quadtree.h"
+
+// geometric transforms, applied to the tree without going through pixels
+#define TRANSFORM_FLIP_H 0  // mirror left to right
+#define TRANSFORM_FLIP_V 1  // mirror top to bottom
+#define TRANSFORM_ROT90 2   // quarter turn clockwise
+#define TRANSFORM_ROT180 3  // half turn
+#define TRANSFORM_ROT270 4  // quarter turn counterclockwise
+#define TRANSFORM_CROP_TL 5 // top left quadrant
+#define TRANSFORM_CROP_TR 6 // top right quadrant
+#define TRANSFORM_CROP_BR 7 // bottom right quadrant
+#define TRANSFORM_CROP_BL 8 // bottom left quadrant
+
+/// @brief Builds the transformed copy of a QuadTree. Flips and rotations
+/// reorder the children of every node, a crop keeps the subtree of a
+/// quadrant, so the pixels are never computed and nothing is lost.
+/// @param qt The QuadTree, every node must be set.
+/// @param op One of the TRANSFORM_* operations.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return The transformed QuadTree, NULL if it could not be built.
+QuadTree *transformQuadTree(QuadTree *qt, int op, int verbose);
+
+#endif
@@ -5,12 +5,15 @@
   =========================================== */
 
 #include "coder.h"
+#include "parallel.h"
 #include "quadtree.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <time.h>
+#include <string.h>
 
 
 /**
@@ -23,94 +26,493 @@
  *  - We only to consider the uniformity bit when the error bit is 0
  *  - For the last level, we only need to store the average intensity
  *
+ *  **** HEADER ****
+ *  - A fixed size binary header (QTCHeader) gives the shape of the image, the
+ *    level of the index and the sizes of the metadata and of the payload, so
+ *    a reader skips the metadata with a single seek
+ *  - The metadata are optional comment lines, nothing is written by default
+ *
+ *  **** INDEXED FILES ****
+ *  - The levels 0 to k are written first, then the descendants of each node
+ *    of level k, one subtree after the other and level by level inside it
+ *  - The header holds k and the bit offset of each of the 4^k subtrees
+ *  - The subtrees are serialized in parallel, each thread in its own buffer,
+ *    and the buffers are concatenated at the end
+ *
  *  **** RULE FOR LOSSY COMPRESSION ****
  *  - If the variance of a node is less than the threshold, we consider the node
  *    as uniform
+ *  - The variance is the standard deviation of the pixels of the node, derived
+ *    from its moments, or the recursive approximation of the first versions
+ *    in VARIANCE_LEGACY mode
  */
 
-/// @brief Writes bits to the file, ensuring they are packed into bytes in
+/// @brief Bits being written in memory, the full bytes are in data and the
+/// last bitCount bits are in bitField.
+typedef struct {
+  unsigned char *data;    // full bytes
+  size_t size;            // number of full bytes
+  size_t capacity;        // number of bytes data can hold
+  unsigned char bitField; // the current byte being filled
+  int bitCount;           // the count of bits written to the bitField so far
+  int error;              // 1 if data could not grow
+} BitBuffer;
+
+/// @brief Appends a full byte to the buffer.
+/// @param buffer The buffer to write to.
+/// @param byte The byte to append.
+static void pushByte(BitBuffer *buffer, unsigned char byte) {
+  if (buffer->size == buffer->capacity) {
+    size_t capacity = buffer->capacity == 0 ? 4096 : 2 * buffer->capacity;
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+      buffer->error = 1;
+      return;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+  }
+  buffer->data[buffer->size++] = byte;
+}
+
+/// @brief Writes bits to the buffer, ensuring they are packed into bytes in
 /// order from least to most significant bits.
-/// @param file The file to write to.
-/// @param bitField The bitField holding the current byte being filled.
-/// @param bitCount The count of bits written to the bitField so far.
+/// @param buffer The buffer to write to.
 /// @param bits The bits to write.
 /// @param numBits The number of bits to write.
-static void writeBits(FILE *file, unsigned char *bitField, int *bitCount,
-                      unsigned char bits, int numBits) {
-  assert(file != NULL);
-  assert(bitField != NULL);
-  assert(bitCount != NULL);
+static void writeBits(BitBuffer *buffer, unsigned char bits, int numBits) {
+  assert(buffer != NULL);
   assert(numBits <= __CHAR_BIT__);
   assert(numBits >= 0);
   for (int i = 0; i < numBits; i++) {
     // get the i-th from the left
     unsigned char leastSignificantBit = (bits >> (numBits - 1 - i)) & 1U;
     // shift the bitField to the left and add the new bit
-    *bitField = (*bitField << 1) | leastSignificantBit;
-    (*bitCount)++;
-    if (*bitCount == __CHAR_BIT__) { // If bitField is full, write to file
-      fwrite(bitField, sizeof(unsigned char), 1, file);
-      *bitField = 0; // Reset bitField
-      *bitCount = 0; // Reset bit count
+    buffer->bitField = (buffer->bitField << 1) | leastSignificantBit;
+    buffer->bitCount++;
+    if (buffer->bitCount == __CHAR_BIT__) { // If bitField is full, store it
+      pushByte(buffer, buffer->bitField);
+      buffer->bitField = 0; // Reset bitField
+      buffer->bitCount = 0; // Reset bit count
     }
   }
 }
 
-/// @brief writes the QuadTree structure to a file in binary format.
-/// @param file The file to write to.
+/// @brief Number of bits written to the buffer.
+/// @param buffer The buffer.
+/// @return The number of bits.
+static uint64_t bitLength(BitBuffer *buffer) {
+  return (uint64_t)buffer->size * __CHAR_BIT__ + buffer->bitCount;
+}
+
+/// @brief Appends the bits of a buffer to another one. When the destination
+/// does not end on a byte boundary, every byte of the source is shifted.
+/// @param dst The buffer to append to.
+/// @param src The buffer to append.
+static void appendBits(BitBuffer *dst, BitBuffer *src) {
+  int k = dst->bitCount;
+  if (k == 0) {
+    for (size_t i = 0; i < src->size; i++)
+      pushByte(dst, src->data[i]);
+  } else {
+    // the k pending bits of dst are completed by the high bits of each byte,
+    // its low bits become the new pending bits
+    unsigned char mask = (1U << k) - 1;
+    for (size_t i = 0; i < src->size; i++) {
+      unsigned char byte = src->data[i];
+      pushByte(dst, (dst->bitField << (__CHAR_BIT__ - k)) | (byte >> k));
+      dst->bitField = byte & mask;
+    }
+  }
+  writeBits(dst, src->bitField, src->bitCount);
+}
+
+/// @brief Code of the error and uniformity bits of a node, indexed by
+/// (e << 1) | u: `e` on 2 bits, followed by `u` only when `e == 0`.
+typedef struct {
+  unsigned char bits;
+  unsigned char length;
+} FlagCode;
+
+static const FlagCode flagCodes[8] = {
+    {0, 3}, {1, 3}, // e = 0, u follows
+    {1, 2}, {1, 2}, // e = 1
+    {2, 2}, {2, 2}, // e = 2
+    {3, 2}, {3, 2}, // e = 3
+};
+
+/// @brief writes the error and uniformity bits of a node with a single write.
+/// @param buffer The buffer to write to.
+/// @param node The node to write.
+static inline void writeFlags(BitBuffer *buffer, Node node) {
+  FlagCode code = flagCodes[(node.e << 1) | node.u];
+  writeBits(buffer, code.bits, code.length);
+}
+
+/// @brief writes the nodes [first, last) of one level of the QuadTree in
+/// binary format, sibling group by sibling group.
+/// @param buffer The buffer to write to.
 /// @param qt The QuadTree to write.
-/// @param index The index of the current node.
-/// @param bitField The current byte being filled.
-/// @param bitCount The bit count in the current bitField.
-static void writeQuadTree_aux(FILE *file, QuadTree *qt, unsigned char *bitField,
-                              int *bitCount) {
-  assert(file != NULL);
-  assert(qt != NULL);
-  assert(bitField != NULL);
-  assert(bitCount != NULL);
-  for (size_t index = 0; index < totalNodes(qt->numLevels); index++) {
-    Node *node = &qt->root[index];
-    // if the parent node is uniform and has an error of 0, no need to check the
-    // children
-    if (index != 0 && qt->root[(index - 1) / 4].e == 0 &&
-        qt->root[(index - 1) / 4].u == 1)
+/// @param first The index of the first node to write, a first child.
+/// @param last The index following the last node to write.
+/// @param leaf 1 if the level is the last one, 0 otherwise.
+static inline void writeLevel(BitBuffer *buffer, QuadTree *qt, size_t first,
+                              size_t last, int leaf) {
+  for (size_t index = first; index < last; index += 4) {
+    // if the parent node is uniform and has an error of 0, no need to check
+    // the children
+    Node *parent = &qt->root[(index - 1) / 4];
+    if (parent->e == 0 && parent->u == 1)
       continue;
+    // the four siblings are loaded at once
+    Node group[4];
+    memcpy(group, &qt->root[index], sizeof(group));
+    for (int i = 0; i < 4; i++) {
+      // the intensity of the fourth child is implied
+      if (i < 3)
+        writeBits(buffer, group[i].m, __CHAR_BIT__);
+      // leaves have no uniformity and error bits
+      if (!leaf)
+        writeFlags(buffer, group[i]);
+    }
+  }
+}
 
-    // if the node is not the fourth child or is the root
-    if (index % 4 != 0 || index == 0)
-      // write the intesity m (8 bits)
-      writeBits(file, bitField, bitCount, node->m, __CHAR_BIT__);
+/// @brief writes the levels 0 to bottom of the QuadTree in binary format.
+/// @param buffer The buffer to write to.
+/// @param qt The QuadTree to write.
+/// @param bottom The last level to write.
+/// @param height The number of levels of the QuadTree.
+static inline void writeTopLevels(BitBuffer *buffer, QuadTree *qt,
+                                  unsigned char bottom, unsigned char height) {
+  assert(buffer != NULL);
+  assert(qt != NULL);
+  writeBits(buffer, qt->root[0].m, __CHAR_BIT__);
+  if (height > 0)
+    writeFlags(buffer, qt->root[0]);
+  for (unsigned char d = 1; d <= bottom; d++)
+    writeLevel(buffer, qt, LEVEL_START(d), LEVEL_START(d + 1), d == height);
+}
 
-    // Check if the node is a leaf we skip writing the uniformity and error bits
-    if (index >= totalNodes(qt->numLevels - 1))
-      continue;
+/// @brief writes the descendants of a node level by level.
+/// @param buffer The buffer to write to.
+/// @param qt The QuadTree to write.
+/// @param index The index of the root of the subtree.
+/// @param depth The depth of the root of the subtree.
+static void writeSubtree(BitBuffer *buffer, QuadTree *qt, size_t index,
+                         unsigned char depth) {
+  for (unsigned char d = 1; depth + d <= qt->numLevels; d++) {
+    size_t first = firstDescendant(index, d);
+    writeLevel(buffer, qt, first, first + ((size_t)1 << (2 * d)),
+               depth + d == qt->numLevels);
+  }
+}
+
+/// @brief Subtrees of the index serialized by one thread in its own buffer
+typedef struct {
+  QuadTree *qt;
+  uint64_t *offsets;   // bit offsets of all the subtrees
+  unsigned char level; // level of the index
+  size_t first;        // first subtree to write
+  size_t last;         // subtree following the last one to write
+  BitBuffer buffer;    // bits of the subtrees [first, last)
+} SubtreeJob;
 
-    // Write `e` (2 bits)
-    writeBits(file, bitField, bitCount, node->e, 2);
-    // Write `u` only if `e == 0` (1 bit)
-    if (node->e == 0)
-      writeBits(file, bitField, bitCount, node->u, 1);
+/// @brief Writes the subtrees [first, last) of a job in its buffer, the
+/// offsets are relative to the start of the buffer.
+/// @param arg The job
+/// @return NULL
+static void *writeSubtrees(void *arg) {
+  SubtreeJob *job = (SubtreeJob *)arg;
+  size_t firstNode = totalNodes(job->level - 1);
+  for (size_t i = job->first; i < job->last; i++) {
+    job->offsets[i] = bitLength(&job->buffer);
+    writeSubtree(&job->buffer, job->qt, firstNode + i, job->level);
   }
-  return;
+  return NULL;
 }
 
-/// @brief Writes the entire QuadTree to a binary file in specified format.
+/// @brief Writes the subtrees of the index after the top levels. They are
+/// independent so they are split between threads, then the buffers of the
+/// threads are concatenated in order.
+/// @param buffer The buffer holding the top levels.
 /// @param qt The QuadTree to write.
-/// @param filename The name of the file to write to.
-static void writeQuadTree(QuadTree *qt, FILE *file) {
-  assert(qt != NULL);
-  assert(file != NULL);
-  unsigned char bitField = 0;
-  int bitCount = 0;
-  // Write the QuadTree to the file
-  writeQuadTree_aux(file, qt, &bitField, &bitCount);
+/// @param level The level of the index.
+/// @param offsets The bit offset of each subtree from the start of the
+/// bitstream.
+/// @param start The bit offset of the start of the bitstream in the buffer.
+/// @return 0 if successful, -1 if a buffer could not be allocated.
+static int writeIndexedSubtrees(BitBuffer *buffer, QuadTree *qt,
+                                unsigned char level, uint64_t *offsets,
+                                uint64_t start) {
+  size_t numSubtrees = (size_t)1 << (2 * level);
+  size_t numThreads = parallelThreads(numSubtrees);
+
+  SubtreeJob jobs[numThreads];
+  for (size_t t = 0; t < numThreads; t++)
+    jobs[t] = (SubtreeJob){qt, offsets, level, t * numSubtrees / numThreads,
+                           (t + 1) * numSubtrees / numThreads,
+                           (BitBuffer){NULL, 0, 0, 0, 0, 0}};
+  runParallel(writeSubtrees, jobs, sizeof(SubtreeJob), numThreads);
+  for (size_t t = 0; t < numThreads; t++) {
+    // shift the offsets of the job by the bits already in the bitstream
+    uint64_t base = bitLength(buffer) - start;
+    for (size_t i = jobs[t].first; i < jobs[t].last; i++)
+      offsets[i] += base;
+    appendBits(buffer, &jobs[t].buffer);
+    buffer->error |= jobs[t].buffer.error;
+    free(jobs[t].buffer.data);
+  }
+  return buffer->error ? -1 : 0;
+}
+
+/// @brief Writes the bytes of a buffer, then its last bits padded with 0.
+/// @param file The file to write to.
+/// @param buffer The buffer.
+static void writeBitstream(FILE *file, BitBuffer *buffer) {
+  fwrite(buffer->data, sizeof(unsigned char), buffer->size, file);
   // Write any remaining bits
-  if (bitCount > 0) {
-    bitField <<= (__CHAR_BIT__ - bitCount); // Shift remaining bits to the left
-    fwrite(&bitField, sizeof(unsigned char), 1, file);
+  if (buffer->bitCount > 0) {
+    // Shift remaining bits to the left
+    unsigned char last = buffer->bitField << (__CHAR_BIT__ - buffer->bitCount);
+    fwrite(&last, sizeof(unsigned char), 1, file);
   }
 }
 
+/// @brief Stores an integer in little endian.
+/// @param bytes The bytes to fill.
+/// @param value The integer.
+/// @param n The number of bytes.
+static void storeLE(unsigned char *bytes, uint64_t value, int n) {
+  for (int b = 0; b < n; b++)
+    bytes[b] = (value >> (8 * b)) & 0xFF;
+}
+
+/// @brief Stores the fixed size header of a file.
+/// @param bytes The QTC_HEADER_SIZE bytes to fill.
+/// @param header The header.
+static void storeHeader(unsigned char *bytes, const QTCHeader *header) {
+  memcpy(bytes, QTC_MAGIC, 4);
+  bytes[4] = header->version;
+  bytes[5] = header->depth;
+  bytes[6] = header->levels;
+  bytes[7] = header->indexLevel;
+  storeLE(bytes + 8, header->flags, 4);
+  storeLE(bytes + 12, header->width, 4);
+  storeLE(bytes + 16, header->height, 4);
+  storeLE(bytes + 20, header->metadataSize, 4);
+  storeLE(bytes + 24, header->payloadSize, 8);
+}
+
+/// @brief Writes the fixed size header of a file.
+/// @param file The file to write to.
+/// @param header The header.
+static void writeHeader(FILE *file, const QTCHeader *header) {
+  unsigned char bytes[QTC_HEADER_SIZE];
+  storeHeader(bytes, header);
+  fwrite(bytes, sizeof(unsigned char), QTC_HEADER_SIZE, file);
+}
+
+/// @brief Pads the last bits of a file built in a buffer, then fills the
+/// header, the metadata and the index reserved before its bitstream.
+/// @param buffer The buffer holding the reserved bytes and the bitstream.
+/// @param levels The height of the quadtree.
+/// @param indexLevel The level of the index, 0 if there is no index.
+/// @param offsets The bit offset of each subtree from the start of the
+/// bitstream (4^indexLevel values), unused if there is no index.
+/// @param metadata The comment lines written after the header, NULL for none.
+/// @return 0 if successful, -1 if the buffer could not grow.
+static int finishFile(BitBuffer *buffer, unsigned char levels,
+                      unsigned char indexLevel, const uint64_t *offsets,
+                      const char *metadata) {
+  // the last bits are padded with 0
+  if (buffer->bitCount > 0)
+    writeBits(buffer, 0, __CHAR_BIT__ - buffer->bitCount);
+  if (buffer->error)
+    return -1;
+  size_t numSubtrees = indexLevel == 0 ? 0 : (size_t)1 << (2 * indexLevel);
+  size_t metadataSize = metadata == NULL ? 0 : strlen(metadata);
+  QTCHeader header = {QTC_VERSION,
+                      __CHAR_BIT__,
+                      levels,
+                      indexLevel,
+                      indexLevel == 0 ? 0 : QTC_FLAG_INDEXED,
+                      (uint32_t)1 << levels,
+                      (uint32_t)1 << levels,
+                      (uint32_t)metadataSize,
+                      buffer->size - QTC_HEADER_SIZE - metadataSize};
+  storeHeader(buffer->data, &header);
+  if (metadataSize > 0)
+    memcpy(buffer->data + QTC_HEADER_SIZE, metadata, metadataSize);
+  // each bit offset of the index is stored on 8 bytes
+  unsigned char *index = buffer->data + QTC_HEADER_SIZE + metadataSize;
+  for (size_t i = 0; i < numSubtrees; i++)
+    storeLE(index + 8 * i, offsets[i], 8);
+  return 0;
+}
+
+/// @brief Writes the entire QuadTree in memory in the .qtc format. With an
+/// index, the levels up to indexLevel are written first, then the subtrees
+/// rooted at indexLevel one after the other. The bytes of the header, the
+/// metadata and the index are reserved before the bitstream and filled once
+/// it is built, so the whole file is built in the buffer.
+/// @param qt The QuadTree to write.
+/// @param buffer The empty buffer to write to, its memory may be kept from
+/// a previous encoding.
+/// @param indexLevel The level of the index, 0 if there is no index.
+/// @param offsets The bit offset of each subtree from the start of the
+/// bitstream (4^indexLevel values), unused if there is no index.
+/// @param metadata The comment lines written after the header, NULL for none.
+/// @return 0 if successful, -1 if the buffer could not grow.
+static int writeQuadTree(QuadTree *qt, BitBuffer *buffer,
+                         unsigned char indexLevel, uint64_t *offsets,
+                         const char *metadata) {
+  assert(qt != NULL);
+  assert(buffer != NULL);
+  size_t numSubtrees = indexLevel == 0 ? 0 : (size_t)1 << (2 * indexLevel);
+  size_t metadataSize = metadata == NULL ? 0 : strlen(metadata);
+  size_t start = QTC_HEADER_SIZE + metadataSize + numSubtrees * 8;
+  for (size_t i = 0; i < start; i++)
+    pushByte(buffer, 0);
+  if (indexLevel == 0) {
+    // Write the QuadTree to the buffer
+    writeTopLevels(buffer, qt, qt->numLevels, qt->numLevels);
+  } else {
+    writeTopLevels(buffer, qt, indexLevel, qt->numLevels);
+    writeIndexedSubtrees(buffer, qt, indexLevel, offsets,
+                         (uint64_t)start * __CHAR_BIT__);
+  }
+  return finishFile(buffer, qt->numLevels, indexLevel, offsets, metadata);
+}
+
+/// @brief Writes the levels of a SparseQuadTree in binary format, see
+/// writeTopLevels. Its levels hold the stored nodes in the order of the
+/// bitstream: the children of the expanded nodes, sibling group by sibling
+/// group.
+/// @param buffer The buffer to write to.
+/// @param sqt The SparseQuadTree to write.
+static void writeSparseLevels(BitBuffer *buffer, SparseQuadTree *sqt) {
+  Node root = sqt->levels[0].nodes[0];
+  writeBits(buffer, root.m, __CHAR_BIT__);
+  if (sqt->numLevels > 0)
+    writeFlags(buffer, root);
+  for (unsigned char d = 1; d <= sqt->numLevels; d++) {
+    const SparseLevel *level = &sqt->levels[d];
+    for (size_t i = 0; i < level->count; i++) {
+      // the intensity of the fourth child is implied
+      if (i % 4 != 3)
+        writeBits(buffer, level->nodes[i].m, __CHAR_BIT__);
+      // leaves have no uniformity and error bits
+      if (d < sqt->numLevels)
+        writeFlags(buffer, level->nodes[i]);
+    }
+  }
+}
+
+/// @brief Marks the nodes of a frame whose block is the same as in the
+/// reference, from the leaves up: a leaf is unchanged if its mean is, a node
+/// if its four children are (its mean and error then are too).
+/// @param qt The QuadTree of the frame, reconstructed.
+/// @param ref The QuadTree of the previous frame, reconstructed.
+/// @return 1 for each unchanged node and 0 for the others, NULL if it could
+/// not be allocated.
+static unsigned char *markUnchanged(QuadTree *qt, QuadTree *ref) {
+  unsigned char h = qt->numLevels;
+  unsigned char *same = (unsigned char *)malloc(totalNodes(h));
+  if (same == NULL)
+    return NULL;
+  for (size_t index = LEVEL_START(h); index < LEVEL_START(h + 1); index++)
+    same[index] = qt->root[index].m == ref->root[index].m;
+  for (int level = h - 1; level >= 0; level--)
+    for (size_t index = LEVEL_START(level); index < LEVEL_START(level + 1);
+         index++) {
+      const unsigned char *child = &same[4 * index + 1];
+      same[index] = child[0] & child[1] & child[2] & child[3];
+    }
+  return same;
+}
+
+/// @brief Copies a changed node of a frame in the reference, as the decoder
+/// does: the descendants of a uniform node take its intensity.
+/// @param ref The reference.
+/// @param node The node of the frame.
+/// @param index The index of the node.
+/// @param level The level of the node.
+static void updateReference(QuadTree *ref, Node node, size_t index,
+                            unsigned char level) {
+  // the uniformity bit is only stored when the error is 0
+  node.u = node.e == 0 ? node.u : 0;
+  if (level < ref->numLevels && node.e == 0 && node.u == 1)
+    fillUniform(ref, index, level, node.m);
+  else
+    ref->root[index] = node;
+}
+
+/// @brief writes the changed children of a changed node, then theirs, depth
+/// first: a bit per child tells if it is the same as in the reference, then
+/// the changed children are written as in writeLevel. The intensity of the
+/// fourth child is still implied, the unchanged ones are in the reference.
+/// The reference is updated on the way.
+/// @param buffer The buffer to write to.
+/// @param qt The QuadTree of the frame, reconstructed.
+/// @param ref The reference, the previous frame.
+/// @param same The unchanged nodes, see markUnchanged.
+/// @param index The index of the changed node, which is not uniform.
+/// @param level The level of the changed node.
+/// @return The number of changed nodes written.
+static size_t writeChangedChildren(BitBuffer *buffer, QuadTree *qt,
+                                   QuadTree *ref, const unsigned char *same,
+                                   size_t index, unsigned char level) {
+  size_t first = 4 * index + 1;
+  int leaf = level + 1 == qt->numLevels;
+  writeBits(buffer,
+            same[first] << 3 | same[first + 1] << 2 | same[first + 2] << 1 |
+                same[first + 3],
+            4);
+  size_t written = 0;
+  for (int i = 0; i < 4; i++) {
+    if (same[first + i])
+      continue;
+    if (i < 3)
+      writeBits(buffer, qt->root[first + i].m, __CHAR_BIT__);
+    if (!leaf)
+      writeFlags(buffer, qt->root[first + i]);
+    written++;
+  }
+  for (int i = 0; i < 4; i++) {
+    if (same[first + i])
+      continue;
+    Node node = qt->root[first + i];
+    updateReference(ref, node, first + i, level + 1);
+    if (!leaf && (node.e != 0 || node.u != 1))
+      written += writeChangedChildren(buffer, qt, ref, same, first + i,
+                                      level + 1);
+  }
+  return written;
+}
+
+/// @brief Variance of the pixels of a node, from its moments.
+/// @param qt The QuadTree, with its moments.
+/// @param index The index of the node.
+/// @param n The number of pixels of the node.
+/// @return The variance of the pixels of the node.
+static inline double momentVariance(QuadTree *qt, size_t index, double n) {
+  uint64_t sum, sumSq;
+  nodeMoments(qt, index, &sum, &sumSq);
+  double mean = sum / n;
+  // a block with a single intensity gives exactly 0
+  double variance = ((double)sumSq - (double)sum * mean) / n;
+  return variance > 0. ? variance : 0.;
+}
+
+/// @brief Number of pixels of the nodes of a level.
+/// @param qt The QuadTree.
+/// @param level The level.
+/// @return The number of pixels.
+static inline double levelPixels(QuadTree *qt, int level) {
+  return ldexp(1., 2 * (qt->numLevels - level));
+}
+
 /// @brief Calculates the average and maximum variance of the QuadTree.
 /// @param qt The QuadTree to calculate the variance of.
 /// @param max maximum variance
@@ -119,60 +521,173 @@ static void getAverageMaxVariance(QuadTree *qt, double *max, double *average) {
   assert(qt != NULL);
   assert(max != NULL);
   assert(average != NULL);
+  // a tree without internal nodes has no variance
+  *max = 0.;
+  *average = 0.;
   size_t numNodes = totalNodes(qt->numLevels - 1);
   if (numNodes == 0)
     return;
-  *max = 0.;
-  *average = 0.;
-  for (size_t i = 0; i < numNodes; i++) {
-    Node *node = &qt->root[i];
-    *average += node->v;
-    if (node->v > *max)
-      *max = node->v;
+  if (qt->sum != NULL) {
+    // the standard deviations are only derived here, level by level
+    for (int level = 0; level < qt->numLevels; level++) {
+      double n = levelPixels(qt, level);
+      for (size_t i = LEVEL_START(level); i < LEVEL_START(level + 1); i++) {
+        double variance = momentVariance(qt, i, n);
+        double deviation = variance > 0. ? sqrt(variance) : 0.;
+        *average += deviation;
+        if (deviation > *max)
+          *max = deviation;
+      }
+    }
+  } else {
+    for (size_t i = 0; i < numNodes; i++) {
+      *average += qt->v[i];
+      if (qt->v[i] > *max)
+        *max = qt->v[i];
+    }
   }
   *average /= numNodes;
 }
 
-int filterQuadTree_aux(QuadTree *qt, size_t index, double sigma, double alpha,
-                       double beta) {
-  assert(qt != NULL);
-  assert(index >= 0);
+/// @brief Computes the variance threshold of each level of the QuadTree.
+/// The root uses sigma, and going one level down multiplies the threshold by
+/// alpha while alpha itself becomes alpha^beta.
+/// @param numLevels The number of levels of the QuadTree.
+/// @param sigma The threshold of the root.
+/// @param alpha The threshold for variance.
+/// @param beta The second threshold for variance.
+/// @param thresholds The thresholds of the levels 0 to numLevels - 1.
+static void levelThresholds(unsigned char numLevels, double sigma,
+                            double alpha, double beta, double *thresholds) {
   assert(sigma >= 0);
   assert(alpha >= 0);
+  for (unsigned char level = 0; level < numLevels; level++) {
+    thresholds[level] = sigma;
+    sigma *= alpha;
+    // add beta param to increase the quality of compression
+    alpha = pow(alpha, beta);
+  }
+}
 
-  // if the node is already uniform or a leaf node
-  if (qt->root[index].e == 0 && qt->root[index].u == 1)
-    return 1;
+/// @brief Records a node in the filter log before it is uniformized.
+/// @param log The log to append to.
+/// @param qt The QuadTree being filtered.
+/// @param index The index of the node.
+/// @return 0 if successful, -1 if the log could not grow.
+static int logNode(FilterLog *log, QuadTree *qt, size_t index) {
+  if (log->count == log->capacity) {
+    size_t capacity = log->capacity == 0 ? 256 : 2 * log->capacity;
+    size_t *indices = realloc(log->index, capacity * sizeof(size_t));
+    if (indices == NULL)
+      return -1;
+    log->index = indices;
+    Node *nodes = realloc(log->node, capacity * sizeof(Node));
+    if (nodes == NULL)
+      return -1;
+    log->node = nodes;
+    log->capacity = capacity;
+  }
+  log->index[log->count] = index;
+  log->node[log->count] = qt->root[index];
+  log->count++;
+  return 0;
+}
 
-  size_t childIndex = 4 * index + 1;
-  unsigned char uniformize = 1;
-  for (size_t i = 0; i < 4; i++)
-    // recursively check the children
-    // add beta param to increase the quality of compression
-    uniformize &= filterQuadTree_aux(qt, childIndex + i, sigma * alpha,
-                                     pow(alpha, beta), beta);
-  if (!uniformize || qt->root[index].v > sigma)
-    return 0;
-  // if the children are uniform and the variance is less than the threshold
-  // alpha, we consider the node as uniform
-  qt->root[index].e = 0;
-  qt->root[index].u = 1;
-  return 1;
+/// @brief Uniformizes the nodes [first, last) of one level whose children are
+/// all uniform and whose variance does not exceed the threshold. The nodes
+/// are independent from each other, the level below must be done first.
+/// @param qt The QuadTree to filter.
+/// @param first The index of the first node of the level.
+/// @param last The index following the last node of the level.
+/// @param n The number of pixels of the nodes of the level.
+/// @param sigma The threshold of the level.
+/// @param log If not NULL, the uniformized nodes are recorded in it.
+/// @return 0 if successful, -1 if the log could not grow.
+static int filterLevel(QuadTree *qt, size_t first, size_t last, double n,
+                       double sigma, FilterLog *log) {
+  Node *root = qt->root;
+  // the variances of the moments are compared to the squared threshold, the
+  // square root is not needed
+  double sigmaSq = sigma * sigma;
+  for (size_t index = first; index < last; index++) {
+    // if the node is already uniform
+    if (root[index].e == 0 && root[index].u == 1)
+      continue;
+    Node *child = &root[4 * index + 1];
+    unsigned char uniformize =
+        (child[0].e == 0 && child[0].u == 1) &
+        (child[1].e == 0 && child[1].u == 1) &
+        (child[2].e == 0 && child[2].u == 1) &
+        (child[3].e == 0 && child[3].u == 1);
+    if (!uniformize)
+      continue;
+    if (qt->sum != NULL ? momentVariance(qt, index, n) > sigmaSq
+                        : qt->v[index] > sigma)
+      continue;
+    if (log != NULL && logNode(log, qt, index) == -1)
+      return -1;
+    // if the children are uniform and the variance is less than the threshold
+    // alpha, we consider the node as uniform
+    root[index].e = 0;
+    root[index].u = 1;
+  }
+  return 0;
 }
 
-void filterQuadTree(QuadTree *qt, double alpha, double beta, int verbose) {
+int filterQuadTreeLogged(QuadTree *qt, double alpha, double beta,
+                         FilterLog *log, int verbose) {
   assert(qt != NULL);
+  assert(qt->sum != NULL || qt->v != NULL);
   assert(alpha >= 0);
   assert(beta >= 0);
 
   print_verbose(verbose, "\x1b[1;32mFiltering the QuadTree...\x1b[0m");
   double maxVar, medVar;
   getAverageMaxVariance(qt, &maxVar, &medVar);
-  filterQuadTree_aux(qt, 0, medVar / maxVar, alpha, beta);
+  // the blocks of an image with a single intensity are already uniform
+  if (maxVar == 0.) {
+    print_verbose(verbose, "\x1b[1;32mFiltering successful!\x1b[0m");
+    return 0;
+  }
+  double thresholds[UCHAR_MAX + 1];
+  levelThresholds(qt->numLevels, medVar / maxVar, alpha, beta, thresholds);
+  // the leaves are always uniform, the tree is filtered from the level above
+  // them up to the root so that a node is only checked once its children are
+  for (int level = qt->numLevels - 1; level >= 0; level--) {
+    if (filterLevel(qt, LEVEL_START(level), LEVEL_START(level + 1),
+                    levelPixels(qt, level), thresholds[level], log) == -1) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: memory allocation failed\n");
+      return -1;
+    }
+  }
   print_verbose(verbose, "\x1b[1;32mFiltering successful!\x1b[0m");
+  return 0;
+}
+
+void filterQuadTree(QuadTree *qt, double alpha, double beta, int verbose) {
+  filterQuadTreeLogged(qt, alpha, beta, NULL, verbose);
+}
+
+void undoFilter(QuadTree *qt, FilterLog *log) {
+  assert(qt != NULL);
+  assert(log != NULL);
+  // restore in reverse order, a node is logged at most once per filter
+  while (log->count > 0) {
+    log->count--;
+    qt->root[log->index[log->count]] = log->node[log->count];
+  }
+}
+
+void freeFilterLog(FilterLog *log) {
+  free(log->index);
+  free(log->node);
+  log->index = NULL;
+  log->node = NULL;
+  log->count = log->capacity = 0;
 }
 
-int QTC_encoder(QuadTree *qt, const char *filename, int verbose) {
+int QTC_encoder(QuadTree *qt, const char *filename, unsigned char indexLevel,
+                const char *metadata, int verbose) {
   assert(qt != NULL);
   assert(filename != NULL);
 
@@ -185,38 +700,196 @@ int QTC_encoder(QuadTree *qt, const char *filename, int verbose) {
   FILE *file = fopen(filename, "wb");
   if (file == NULL)
     return -1;
-  // Write the magic number
-  print_verbose(verbose, "\tWriting the magic number");
-  fprintf(file, "Q1\n");
-  // Write the date and hour of creation of the file
-  time_t t = time(NULL);
-  struct tm tm = *localtime(&t);
-  char buffer[32];
-  if (strftime(buffer, sizeof(buffer), "%c", &tm) == 0) {
-    fprintf(stderr, "\x1b[1;31mError:\x1b[0m writing the date to the file\n");
-    return -1;
+  int status = QTC_encoderStream(qt, file, indexLevel, metadata, verbose);
+  fclose(file);
+  if (status == 0) {
+    sprintf(message,
+            "\x1b[1;32mSaving the encoding to\x1b[0m \x1b[1;35m%s\x1b[0m\n",
+            filename);
+    print_verbose(verbose, message);
   }
-  fprintf(file, "# %s\n", buffer);
-  size_t totalSize = calculateSize(qt, 0);
-  // round up to the nearest byte
-  totalSize += __CHAR_BIT__ - (totalSize % __CHAR_BIT__);
-  size_t numPixels = 1 << (2 * qt->numLevels);
+  return status;
+}
 
-  float compression_rate = (float)totalSize / (numPixels * __CHAR_BIT__) * 100;
+/// @brief Encodes the QuadTree in a buffer, see QTC_encoderStream.
+/// @param qt The QuadTree to write.
+/// @param buffer The empty buffer to write to.
+/// @param indexLevel 0 for no index, otherwise the level of the index.
+/// @param metadata comment lines stored after the header, NULL for none.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise.
+static int encodeBuffer(QuadTree *qt, BitBuffer *buffer,
+                        unsigned char indexLevel, const char *metadata,
+                        int verbose) {
+  char message[100];
 
+  // the subtrees of the index must have at least one level below their root
+  if (indexLevel >= qt->numLevels)
+    indexLevel = qt->numLevels == 0 ? 0 : qt->numLevels - 1;
+  if (indexLevel > QTC_MAX_INDEX_LEVEL)
+    indexLevel = QTC_MAX_INDEX_LEVEL;
+  size_t numSubtrees = (size_t)1 << (2 * indexLevel);
+  uint64_t *offsets = NULL;
+  if (indexLevel > 0) {
+    offsets = (uint64_t *)malloc(numSubtrees * sizeof(uint64_t));
+    if (offsets == NULL)
+      return -1;
+    sprintf(message, "\tWriting the index of the \x1b[1;35m%zu\x1b[0m subtrees",
+            numSubtrees);
+    print_verbose(verbose, message);
+  }
+  if (writeQuadTree(qt, buffer, indexLevel, offsets, metadata) == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: memory allocation failed\n");
+    free(offsets);
+    return -1;
+  }
+  size_t numPixels = (size_t)1 << (2 * qt->numLevels);
   sprintf(message, "\tCompression rate: \x1b[1;4;35m%.2f%%\x1b[0m",
-          compression_rate);
+          (double)buffer->size / numPixels * 100);
   print_verbose(verbose, message);
-
-  fprintf(file, "# compression rate %.2f%%\n", compression_rate);
-  // write the number of levels
-  fwrite(&qt->numLevels, sizeof(unsigned char), 1, file);
-  writeQuadTree(qt, file);
+  free(offsets);
   print_verbose(verbose, "\x1b[1;32mEncoding successful!\x1b[0m");
+  return 0;
+}
+
+int QTC_encoderStream(QuadTree *qt, FILE *file, unsigned char indexLevel,
+                      const char *metadata, int verbose) {
+  assert(qt != NULL);
+  assert(file != NULL);
+  BitBuffer buffer = {NULL, 0, 0, 0, 0, 0};
+  int status = encodeBuffer(qt, &buffer, indexLevel, metadata, verbose);
+  if (status == 0 &&
+      fwrite(buffer.data, sizeof(unsigned char), buffer.size, file) !=
+          buffer.size)
+    status = -1;
+  free(buffer.data);
+  return status == 0 && !ferror(file) ? 0 : -1;
+}
+
+int QTC_encoderBuffer(QuadTree *qt, unsigned char **data, size_t *capacity,
+                      size_t *size, unsigned char indexLevel,
+                      const char *metadata, int verbose) {
+  assert(qt != NULL);
+  assert(data != NULL && capacity != NULL && size != NULL);
+  BitBuffer buffer = {*data, 0, *capacity, 0, 0, 0};
+  int status = encodeBuffer(qt, &buffer, indexLevel, metadata, verbose);
+  // the buffer may have moved even if the encoding failed
+  *data = buffer.data;
+  *capacity = buffer.capacity;
+  *size = status == 0 ? buffer.size : 0;
+  return status;
+}
+
+int QTC_encoderSparse(SparseQuadTree *sqt, const char *filename,
+                      const char *metadata, int verbose) {
+  assert(sqt != NULL);
+  assert(filename != NULL);
+  char message[100];
+  snprintf(message, sizeof(message),
+           "\x1b[1;32mWriting the encoding to\x1b[0m \x1b[1;35m%s\x1b[0m",
+           filename);
+  print_verbose(verbose, message);
+
+  BitBuffer buffer = {NULL, 0, 0, 0, 0, 0};
+  size_t start = QTC_HEADER_SIZE + (metadata == NULL ? 0 : strlen(metadata));
+  for (size_t i = 0; i < start; i++)
+    pushByte(&buffer, 0);
+  writeSparseLevels(&buffer, sqt);
+  if (finishFile(&buffer, sqt->numLevels, 0, NULL, metadata) == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: memory allocation failed\n");
+    free(buffer.data);
+    return -1;
+  }
+  FILE *file = fopen(filename, "wb");
+  int status = file == NULL ||
+                       fwrite(buffer.data, sizeof(unsigned char), buffer.size,
+                              file) != buffer.size
+                   ? -1
+                   : 0;
+  if (file != NULL && fclose(file) != 0)
+    status = -1;
+  free(buffer.data);
+  sprintf(message, "\t\x1b[1;35m%zu\x1b[0m nodes written",
+          sparseNodeCount(sqt));
+  print_verbose(verbose, message);
+  return status;
+}
+
+int QTC_encoderInter(QuadTree *qt, QuadTree *ref, const char *filename,
+                     int verbose) {
+  assert(qt != NULL);
+  assert(ref != NULL);
+  assert(filename != NULL);
+  if (qt->numLevels != ref->numLevels) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: the frames differ in size\n");
+    return -1;
+  }
+  char message[150];
   sprintf(message,
-          "\x1b[1;32mSaving the encoding to\x1b[0m \x1b[1;35m%s\x1b[0m\n",
+          "\x1b[1;32mWriting the changes to\x1b[0m \x1b[1;35m%.80s\x1b[0m",
           filename);
   print_verbose(verbose, message);
-  fclose(file);
-  return 0;
-}
\ No newline at end of file
+
+  // the frame is compared with the reference as the decoder holds it
+  reconstructQuadTree(qt);
+  uint64_t refId = hashQuadTree(ref);
+  unsigned char *same = markUnchanged(qt, ref);
+  if (same == NULL) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: memory allocation failed\n");
+    return -1;
+  }
+  BitBuffer buffer = {NULL, 0, 0, 0, 0, 0};
+  size_t written = 0;
+  // an unchanged frame is a single bit
+  writeBits(&buffer, same[0], 1);
+  if (!same[0]) {
+    Node root = qt->root[0];
+    writeBits(&buffer, root.m, __CHAR_BIT__);
+    if (qt->numLevels > 0)
+      writeFlags(&buffer, root);
+    updateReference(ref, root, 0, 0);
+    written = 1;
+    if (qt->numLevels > 0 && (root.e != 0 || root.u != 1))
+      written += writeChangedChildren(&buffer, qt, ref, same, 0, 0);
+  }
+  free(same);
+  if (buffer.error) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: memory allocation failed\n");
+    free(buffer.data);
+    return -1;
+  }
+  // the payload starts with the identities of the reference and of the frame
+  unsigned char ids[QTC_FRAME_IDS_SIZE];
+  storeLE(ids, refId, 8);
+  storeLE(ids + 8, written == 0 ? refId : hashQuadTree(ref), 8);
+
+  FILE *file = fopen(filename, "wb");
+  if (file == NULL) {
+    free(buffer.data);
+    return -1;
+  }
+  QTCHeader header = {QTC_VERSION,
+                      __CHAR_BIT__,
+                      qt->numLevels,
+                      0,
+                      QTC_FLAG_INTER,
+                      (uint32_t)1 << qt->numLevels,
+                      (uint32_t)1 << qt->numLevels,
+                      0,
+                      QTC_FRAME_IDS_SIZE + buffer.size +
+                          (buffer.bitCount > 0)};
+  writeHeader(file, &header);
+  fwrite(ids, sizeof(unsigned char), QTC_FRAME_IDS_SIZE, file);
+  writeBitstream(file, &buffer);
+  free(buffer.data);
+  int status = ferror(file) ? -1 : 0;
+  if (fclose(file) != 0)
+    status = -1;
+  sprintf(message,
+          "\t\x1b[1;35m%zu\x1b[0m changed nodes written out of %zu, "
+          "\x1b[1;35m%llu\x1b[0m bytes",
+          written, totalNodes(qt->numLevels),
+          (unsigned long long)(QTC_HEADER_SIZE + header.payloadSize));
+  print_verbose(verbose, message);
+  return status;
+}
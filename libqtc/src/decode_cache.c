@@ -0,0 +1,300 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#include "decode_cache.h"
+#include "large_alloc.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// @brief A cached pixmap, in a list ordered from the most to the least
+/// recently used and in the chain of its bucket.
+typedef struct Entry {
+  uint64_t hash;           // hash of the encoded content
+  size_t size;             // size of the encoded content
+  unsigned char *content;  // encoded content, compared on a hit
+  unsigned char *pixmap;   // decoded pixmap
+  size_t width;            // width of the pixmap
+  unsigned char grayScale; // grayscale of the image
+  char *comments;          // comments of the image, NULL if there are none
+  size_t bytes;            // memory used by the entry
+  size_t refs;             // number of images borrowing the pixmap
+  int cached;              // 0 once removed, freed by the last borrower
+  struct Entry *prev;      // more recently used entry
+  struct Entry *next;      // less recently used entry
+  struct Entry *chain;     // next entry of the same bucket
+} Entry;
+
+// buckets of the first table, a power of two
+#define MIN_BUCKETS 64
+
+// the cache is shared by the threads decoding at the same time
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static Entry *head = NULL; // most recently used entry
+static Entry *tail = NULL; // least recently used entry
+// the entries are indexed by their hash, the list only keeps their order
+static Entry **buckets = NULL;
+static size_t numBuckets = 0; // a power of two, 0 until the first entry
+static DecodeCacheStats stats = {0, 0, 0, 0, 0, 0};
+
+/// @brief Frees an entry.
+/// @param entry The entry, may be NULL.
+static void freeEntry(Entry *entry) {
+  if (entry == NULL)
+    return;
+  largeFree(entry->pixmap);
+  free(entry->content);
+  free(entry->comments);
+  free(entry);
+}
+
+/// @brief Removes an entry from the list, the lock must be held.
+/// @param entry The entry to remove.
+static void detach(Entry *entry) {
+  if (entry->prev != NULL)
+    entry->prev->next = entry->next;
+  else
+    head = entry->next;
+  if (entry->next != NULL)
+    entry->next->prev = entry->prev;
+  else
+    tail = entry->prev;
+  stats.entries--;
+  stats.bytes -= entry->bytes;
+}
+
+/// @brief Inserts an entry as the most recently used, the lock must be held.
+/// @param entry The entry to insert.
+static void pushFront(Entry *entry) {
+  entry->prev = NULL;
+  entry->next = head;
+  if (head != NULL)
+    head->prev = entry;
+  head = entry;
+  if (tail == NULL)
+    tail = entry;
+  stats.entries++;
+  stats.bytes += entry->bytes;
+}
+
+/// @brief Doubles the number of buckets once there are more entries than
+/// buckets, the lock must be held. The table is kept if it cannot grow.
+/// @return 0 if there is a table, -1 otherwise.
+static int growBuckets(void) {
+  if (numBuckets != 0 && stats.entries < numBuckets)
+    return 0;
+  size_t count = numBuckets == 0 ? MIN_BUCKETS : 2 * numBuckets;
+  Entry **table = (Entry **)calloc(count, sizeof(Entry *));
+  if (table == NULL)
+    return numBuckets == 0 ? -1 : 0;
+  for (size_t b = 0; b < numBuckets; b++)
+    for (Entry *entry = buckets[b], *chain; entry != NULL; entry = chain) {
+      chain = entry->chain;
+      Entry **bucket = &table[entry->hash & (count - 1)];
+      entry->chain = *bucket;
+      *bucket = entry;
+    }
+  free(buckets);
+  buckets = table;
+  numBuckets = count;
+  return 0;
+}
+
+/// @brief Removes an entry from the cache, the lock must be held. It is
+/// freed now, or by releaseDecodedImage if its pixmap is borrowed.
+/// @param entry The entry.
+static void removeEntry(Entry *entry) {
+  Entry **link = &buckets[entry->hash & (numBuckets - 1)];
+  while (*link != entry)
+    link = &(*link)->chain;
+  *link = entry->chain;
+  detach(entry);
+  entry->cached = 0;
+  if (entry->refs == 0)
+    freeEntry(entry);
+}
+
+/// @brief Lends the pixmap of an entry to an image, the lock must be held.
+/// @param entry The entry.
+/// @param image The image borrowing the pixmap.
+static void lend(Entry *entry, DecodedImage *image) {
+  entry->refs++;
+  image->pixmap = entry->pixmap;
+  image->width = entry->width;
+  image->grayScale = entry->grayScale;
+  image->comments = entry->comments;
+  image->entry = entry;
+}
+
+/// @brief Evicts the least recently used entries until the given memory is
+/// free, the lock must be held.
+/// @param needed The memory that must fit in the budget.
+static void evict(size_t needed) {
+  while (tail != NULL && stats.bytes + needed > stats.budget) {
+    removeEntry(tail);
+    stats.evictions++;
+  }
+}
+
+/// @brief Finds an entry, the lock must be held. The hash only selects the
+/// candidates, their content is compared.
+/// @param hash The hash of the encoded content.
+/// @param content The encoded content.
+/// @param size The size of the encoded content.
+/// @return The entry, NULL if there is none.
+static Entry *find(uint64_t hash, const unsigned char *content, size_t size) {
+  if (numBuckets == 0)
+    return NULL;
+  for (Entry *entry = buckets[hash & (numBuckets - 1)]; entry != NULL;
+       entry = entry->chain)
+    if (entry->hash == hash && entry->size == size &&
+        memcmp(entry->content, content, size) == 0)
+      return entry;
+  return NULL;
+}
+
+void setDecodeCacheBudget(size_t budget) {
+  pthread_mutex_lock(&lock);
+  stats.budget = budget;
+  evict(0);
+  pthread_mutex_unlock(&lock);
+}
+
+int decodeCacheEnabled(void) {
+  pthread_mutex_lock(&lock);
+  int enabled = stats.budget != 0;
+  pthread_mutex_unlock(&lock);
+  return enabled;
+}
+
+void getDecodeCacheStats(DecodeCacheStats *result) {
+  pthread_mutex_lock(&lock);
+  *result = stats;
+  pthread_mutex_unlock(&lock);
+}
+
+void clearDecodeCache(void) {
+  pthread_mutex_lock(&lock);
+  while (tail != NULL)
+    removeEntry(tail);
+  pthread_mutex_unlock(&lock);
+}
+
+/// @brief Mixes the bits of a word.
+/// @param x The word.
+/// @return The mixed word.
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+uint64_t hashContent(const unsigned char *data, size_t size) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+  size_t i = 0;
+  // 8 bytes at a time, then the remaining bytes
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    h = (h ^ mix(word)) * 0x9e3779b97f4a7c15ULL;
+    h = (h << 27) | (h >> 37);
+  }
+  uint64_t word = 0;
+  if (i < size)
+    memcpy(&word, data + i, size - i);
+  h ^= mix(word);
+  return mix(h);
+}
+
+int acquireDecodeCache(uint64_t hash, const unsigned char *content,
+                       size_t size, DecodedImage *image) {
+  pthread_mutex_lock(&lock);
+  Entry *entry = stats.budget == 0 ? NULL : find(hash, content, size);
+  if (entry == NULL) {
+    stats.misses += stats.budget != 0;
+    pthread_mutex_unlock(&lock);
+    return -1;
+  }
+  // nothing is copied, the entry is kept until the image is released
+  lend(entry, image);
+  // the entry becomes the most recently used
+  detach(entry);
+  pushFront(entry);
+  stats.hits++;
+  pthread_mutex_unlock(&lock);
+  return 0;
+}
+
+void storeDecodeCache(uint64_t hash, const unsigned char *content,
+                      size_t size, DecodedImage *image) {
+  if (image->entry != NULL)
+    return;
+  size_t bytes = sizeof(Entry) + size + image->width * image->width +
+                 (image->comments == NULL ? 0 : strlen(image->comments) + 1);
+  pthread_mutex_lock(&lock);
+  int fits = bytes <= stats.budget;
+  pthread_mutex_unlock(&lock);
+  if (!fits)
+    return;
+
+  // the content is copied before taking the lock, the pixmap is taken over
+  Entry *entry = (Entry *)calloc(1, sizeof(Entry));
+  unsigned char *copy = (unsigned char *)malloc(size == 0 ? 1 : size);
+  if (entry == NULL || copy == NULL) {
+    free(entry);
+    free(copy);
+    return;
+  }
+  memcpy(copy, content, size);
+  entry->hash = hash;
+  entry->size = size;
+  entry->content = copy;
+  entry->pixmap = image->pixmap;
+  entry->width = image->width;
+  entry->grayScale = image->grayScale;
+  entry->comments = image->comments;
+  entry->bytes = bytes;
+  entry->cached = 1;
+
+  pthread_mutex_lock(&lock);
+  // another thread may have decoded the same content, or shrunk the budget
+  if (bytes > stats.budget || find(hash, content, size) != NULL ||
+      growBuckets() == -1) {
+    pthread_mutex_unlock(&lock);
+    free(copy);
+    free(entry);
+    return;
+  }
+  evict(bytes);
+  Entry **bucket = &buckets[hash & (numBuckets - 1)];
+  entry->chain = *bucket;
+  *bucket = entry;
+  pushFront(entry);
+  lend(entry, image);
+  pthread_mutex_unlock(&lock);
+}
+
+void releaseDecodedImage(DecodedImage *image) {
+  Entry *entry = image->entry;
+  if (entry == NULL) {
+    largeFree(image->pixmap);
+    free(image->comments);
+  } else {
+    pthread_mutex_lock(&lock);
+    int unused = --entry->refs == 0 && !entry->cached;
+    pthread_mutex_unlock(&lock);
+    // an evicted entry is freed by its last borrower
+    if (unused)
+      freeEntry(entry);
+  }
+  image->pixmap = NULL;
+  image->comments = NULL;
+  image->entry = NULL;
+}
@@ -5,9 +5,15 @@
   =========================================== */
 
 #include "decoder.h"
+#include "coder.h"
+#include "large_alloc.h"
+#include "parallel.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 /******************************************************************************
@@ -20,22 +26,43 @@
  *    error is 0
  * - For the last level, we read the average intensity, the uniformity is et to
  *1 and error to 0
+ * - In indexed files the levels up to the index are read first, then the
+ *   subtrees below it are independent and are decoded in parallel, each one
+ *   starting at the bit offset given by the index
  *
  ******************************************************************************/
 
-/// @brief  Reads n bits from the file
-/// @param file  The file to read from
+/// @brief Source of a bitstream: an open stream, or bytes held in memory
+typedef struct {
+  FILE *file;                // stream to read from, NULL to read from memory
+  const unsigned char *next; // next byte to read in memory
+  const unsigned char *end;  // end of the bytes in memory
+} BitSource;
+
+/// @brief Reads the next byte of a bitstream, the byte is unchanged past its
+/// end
+/// @param src The bitstream to read from
+/// @param byte The byte to fill
+static inline void readByte(BitSource *src, unsigned char *byte) {
+  if (src->file != NULL)
+    fread(byte, sizeof(unsigned char), 1, src->file);
+  else if (src->next < src->end)
+    *byte = *src->next++;
+}
+
+/// @brief  Reads n bits from the bitstream
+/// @param src  The bitstream to read from
 /// @param bitField  The bitField holding the current byte being filled
 /// @param bitCount  The count of bits read from the bitField so far
 /// @param bits  The bits to read
 /// @param n  The number of bits to read
-static void readBits(FILE *file, unsigned char *bitField, int *bitCount,
+static void readBits(BitSource *src, unsigned char *bitField, int *bitCount,
                      unsigned char *bits, int n) {
   /**
    * read n bits from the bitField, it uses bitCount to keep track of where we
    * stopped reading the last time from the bitField
    */
-  assert(file != NULL);
+  assert(src != NULL);
   assert(bitField != NULL);
   assert(bitCount != NULL);
   assert(bits != NULL);
@@ -44,7 +71,7 @@ static void readBits(FILE *file, unsigned char *bitField, int *bitCount,
   while (n > 0) {
     // if the bitField is empty, we read a new byte
     if (*bitCount == 0) {
-      fread(bitField, sizeof(unsigned char), 1, file);
+      readByte(src, bitField);
       *bitCount = __CHAR_BIT__;
     }
     // calculate the number of bits to read
@@ -60,60 +87,226 @@ static void readBits(FILE *file, unsigned char *bitField, int *bitCount,
   }
 }
 
-void readTree_aux(FILE *file, QuadTree *qt, unsigned char h,
-                  unsigned char *bitField, int *bitCount) {
-  unsigned char m, e, u;
-  for (size_t index = 0; index < totalNodes(h); index++) {
-    Node *node = &qt->root[index];
-    // if the parent node is uniform and has an error of 0
-    if (index != 0 && qt->root[(index - 1) / 4].e == 0 &&
-        qt->root[(index - 1) / 4].u == 1) {
-      // set the intensity of the node to the intensity of the parent
-      // set the uniformity to 1 and the error to 0
-      node->m = qt->root[(index - 1) / 4].m;
-      node->u = 1;
-      node->e = 0;
-      continue;
-    }
+/// @brief Error and uniformity bits given by the next 3 bits of the
+/// bitstream. `u` only follows `e` when `e == 0`, otherwise the last bit
+/// belongs to the next field and is given back.
+typedef struct {
+  unsigned char e;
+  unsigned char u;
+  unsigned char unread; // number of bits to give back
+} FlagCode;
+
+static const FlagCode flagCodes[8] = {
+    {0, 0, 0}, {0, 1, 0}, // e = 0, u follows
+    {1, 0, 1}, {1, 0, 1}, // e = 1
+    {2, 0, 1}, {2, 0, 1}, // e = 2
+    {3, 0, 1}, {3, 0, 1}, // e = 3
+};
 
-    // if the node is not the fourth child or the root
-    if (index % 4 != 0 || index == 0) {
-      // write the intesity m (8 bits)
-      readBits(file, bitField, bitCount, &m, __CHAR_BIT__);
-      node->m = m;
+/// @brief Reads the error and uniformity bits of a node with a single read
+/// @param src The bitstream to read from
+/// @param node The node to fill
+/// @param bitField The bitField holding the current byte being read
+/// @param bitCount The count of bits left in the bitField
+static inline void readFlags(BitSource *src, Node *node,
+                             unsigned char *bitField, int *bitCount) {
+  unsigned char bits;
+  readBits(src, bitField, bitCount, &bits, 3);
+  FlagCode code = flagCodes[bits];
+  node->e = code.e;
+  node->u = code.u;
+  // the last bit read is always in the bitField, it can be given back
+  *bitCount += code.unread;
+}
+
+/// @brief Reads the children of a node that are stored in the bitstream
+/// @param src The bitstream to read from
+/// @param parent The parent of the children
+/// @param group The four children to fill
+/// @param leaf 1 if the children are leaves, 0 otherwise
+/// @param bitField The bitField holding the current byte being read
+/// @param bitCount The count of bits left in the bitField
+static inline void readGroup(BitSource *src, Node parent, Node group[4],
+                             int leaf, unsigned char *bitField,
+                             int *bitCount) {
+  unsigned char m;
+  unsigned int sum = 0;
+  for (int i = 0; i < 3; i++) {
+    readBits(src, bitField, bitCount, &m, __CHAR_BIT__);
+    group[i] = (Node){m, 1, 0};
+    sum += m;
+    if (!leaf)
+      readFlags(src, &group[i], bitField, bitCount);
+  }
+  // calculate the intensity of the fourth child
+  group[3] = (Node){(4 * parent.m + parent.e) - sum, 1, 0};
+  if (!leaf)
+    readFlags(src, &group[3], bitField, bitCount);
+}
+
+/// @brief Reads the nodes [first, last) of one level of the quadtree, sibling
+/// group by sibling group
+/// @param src The bitstream to read from
+/// @param qt The quadtree to fill
+/// @param first The index of the first node to read, a first child
+/// @param last The index following the last node to read
+/// @param leaf 1 if the level is the last one, 0 otherwise
+/// @param bitField The bitField holding the current byte being read
+/// @param bitCount The count of bits left in the bitField
+static inline void readLevel(BitSource *src, QuadTree *qt, size_t first,
+                             size_t last, int leaf, unsigned char *bitField,
+                             int *bitCount) {
+  for (size_t index = first; index < last; index += 4) {
+    Node parent = qt->root[(index - 1) / 4];
+    Node group[4];
+    // if the parent node is uniform and has an error of 0, the children have
+    // its intensity and are uniform with an error of 0
+    if (parent.e == 0 && parent.u == 1) {
+      Node child = {parent.m, 1, 0};
+      group[0] = group[1] = group[2] = group[3] = child;
     } else {
-      // calculate the intensity of the fourth child
-      node->m =
-          (4 * qt->root[(index - 1) / 4].m + qt->root[(index - 1) / 4].e) -
-          (qt->root[index - 3].m + qt->root[index - 2].m +
-           qt->root[index - 1].m);
+      readGroup(src, parent, group, leaf, bitField, bitCount);
     }
+    // the four siblings are stored at once
+    memcpy(&qt->root[index], group, sizeof(group));
+  }
+}
 
-    // Check if the node is a leaf we skip writing the uniformity and error
-    // bits
-    if (index >= totalNodes(h - 1)) {
-      node->u = 1;
-      node->e = 0;
-      continue;
-    }
+/// @brief Reads the levels 0 to bottom of the quadtree
+/// @param src The bitstream to read from
+/// @param qt The quadtree to fill
+/// @param bottom The last level to read
+/// @param height The number of levels of the quadtree
+/// @param bitField The bitField holding the current byte being read
+/// @param bitCount The count of bits left in the bitField
+static inline void readTopLevels(BitSource *src, QuadTree *qt,
+                                 unsigned char bottom, unsigned char height,
+                                 unsigned char *bitField, int *bitCount) {
+  unsigned char m;
+  readBits(src, bitField, bitCount, &m, __CHAR_BIT__);
+  qt->root[0] = (Node){m, 1, 0};
+  if (height > 0)
+    readFlags(src, &qt->root[0], bitField, bitCount);
+  for (unsigned char d = 1; d <= bottom; d++)
+    readLevel(src, qt, LEVEL_START(d), LEVEL_START(d + 1), d == height,
+              bitField, bitCount);
+}
+
+/// @brief Reads the descendants of a node level by level
+/// @param src The bitstream to read from
+/// @param qt The quadtree to fill, the node itself must be read already
+/// @param index The index of the root of the subtree
+/// @param depth The depth of the root of the subtree
+/// @param bitField The bitField holding the current byte being read
+/// @param bitCount The count of bits left in the bitField
+static void readSubtree(BitSource *src, QuadTree *qt, size_t index,
+                        unsigned char depth, unsigned char *bitField,
+                        int *bitCount) {
+  for (unsigned char d = 1; depth + d <= qt->numLevels; d++) {
+    size_t first = firstDescendant(index, d);
+    readLevel(src, qt, first, first + ((size_t)1 << (2 * d)),
+              depth + d == qt->numLevels, bitField, bitCount);
+  }
+}
+
+/// @brief Moves the reading position to a bit offset of the bitstream
+/// @param file The file to read from
+/// @param start The position of the bitstream in the file
+/// @param offset The bit offset from the start of the bitstream
+/// @param bitField The bitField holding the current byte being read
+/// @param bitCount The count of bits left in the bitField
+/// @return 0 if successful, -1 otherwise
+static int seekBits(FILE *file, long start, uint64_t offset,
+                    unsigned char *bitField, int *bitCount) {
+  if (fseek(file, start + (long)(offset / __CHAR_BIT__), SEEK_SET) != 0)
+    return -1;
+  *bitCount = 0;
+  // the offset is in the middle of a byte, keep its remaining bits
+  if (offset % __CHAR_BIT__ != 0) {
+    if (fread(bitField, sizeof(unsigned char), 1, file) != 1)
+      return -1;
+    *bitCount = __CHAR_BIT__ - offset % __CHAR_BIT__;
+  }
+  return 0;
+}
+
+/// @brief Subtrees of an indexed file decoded by one thread
+typedef struct {
+  const char *filename;
+  QuadTree *qt;
+  uint64_t *offsets;    // bit offsets of all the subtrees
+  long start;           // position of the bitstream in the file
+  unsigned char level;  // level of the index
+  size_t first;         // first subtree to decode
+  size_t last;          // subtree following the last one to decode
+  int status;           // 0 if successful, -1 otherwise
+} SubtreeJob;
 
-    // Write `e` (2 bits)
-    readBits(file, bitField, bitCount, &e, 2);
-    node->e = e;
-    // Write `u` only if `e == 0` (1 bit)
-    if (node->e == 0) {
-      readBits(file, bitField, bitCount, &u, 1);
-      node->u = u;
+/// @brief Decodes the subtrees [first, last) of a job, the file is opened
+/// again so that each thread has its own reading position
+/// @param arg The job
+/// @return NULL
+static void *readSubtrees(void *arg) {
+  SubtreeJob *job = (SubtreeJob *)arg;
+  job->status = -1;
+  FILE *file = fopen(job->filename, "rb");
+  if (file == NULL)
+    return NULL;
+  BitSource src = {file, NULL, NULL};
+  size_t firstNode = totalNodes(job->level - 1);
+  for (size_t i = job->first; i < job->last; i++) {
+    unsigned char bitField = 0;
+    int bitCount = 0;
+    if (seekBits(file, job->start, job->offsets[i], &bitField, &bitCount) ==
+        -1) {
+      fclose(file);
+      return NULL;
     }
+    readSubtree(&src, job->qt, firstNode + i, job->level, &bitField,
+                &bitCount);
   }
-  return;
+  fclose(file);
+  job->status = 0;
+  return NULL;
+}
+
+/// @brief Reads the subtrees of an indexed file, they are independent so they
+/// are split between threads
+/// @param filename The name of the file
+/// @param qt The quadtree to fill, the levels up to the index must be read
+/// @param level The level of the index
+/// @param offsets The bit offsets of the subtrees
+/// @param start The position of the bitstream in the file
+/// @return 0 if successful, -1 otherwise
+static int readIndexedSubtrees(const char *filename, QuadTree *qt,
+                               unsigned char level, uint64_t *offsets,
+                               long start) {
+  size_t numSubtrees = (size_t)1 << (2 * level);
+  size_t numThreads = parallelThreads(numSubtrees);
+
+  SubtreeJob jobs[numThreads];
+  for (size_t t = 0; t < numThreads; t++)
+    jobs[t] = (SubtreeJob){filename, qt, offsets, start, level,
+                           t * numSubtrees / numThreads,
+                           (t + 1) * numSubtrees / numThreads, -1};
+  runParallel(readSubtrees, jobs, sizeof(SubtreeJob), numThreads);
+  int status = 0;
+  for (size_t t = 0; t < numThreads; t++)
+    if (jobs[t].status == -1)
+      status = -1;
+  return status;
 }
 
 /// @brief Reads the quadtree from the file
 /// @param qt The quadtree to fill
 /// @param h The number of levels of the quadtree
+/// @param indexLevel The level of the subtree index, 0 if there is none
+/// @param filename The name of the file
+/// @param file The file, positioned after the header
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
 /// @return 0 if the quadtree was read successfully, -1 otherwise
-static int readTree(QuadTree **qt, unsigned char h, FILE *file, int verbose) {
+static int readTree(QuadTree **qt, unsigned char h, unsigned char indexLevel,
+                    const char *filename, FILE *file, int verbose) {
   assert(h > 0);
   assert(file != NULL);
   size_t width = (size_t)1 << h;
@@ -121,34 +314,66 @@ static int readTree(QuadTree **qt, unsigned char h, FILE *file, int verbose) {
   if ((*qt = createQuadTree(width, verbose)) == NULL) {
     return -1;
   }
+  BitSource src = {file, NULL, NULL};
   unsigned char bitField = 0;
   int bitCount = 0;
-  readTree_aux(file, *qt, h, &bitField, &bitCount);
-  return 0;
-}
+  if (indexLevel == 0) {
+    readTopLevels(&src, *qt, h, h, &bitField, &bitCount);
+    return 0;
+  }
 
-int QTC_decoder(const char *filename, QuadTree **qt,
-                         unsigned char *grayScale, char **comments,
-                         int verbose) {
-  FILE *file = fopen(filename, "rb");
-  if (file == NULL) {
+  // read the bit offsets of the subtrees (8 bytes in little endian each)
+  size_t numSubtrees = (size_t)1 << (2 * indexLevel);
+  uint64_t *offsets = (uint64_t *)malloc(numSubtrees * sizeof(uint64_t));
+  if (offsets == NULL) {
+    freeQuadTree(*qt);
     return -1;
   }
-
-  // verbose message
-  char message[100];
-  sprintf(message, "\x1b[1;32mDecoding file \x1b[0m \x1b[1;35m%s\x1b[0m",
-          filename);
-  print_verbose(verbose, message);
-
-  char magicNumber[3];
-  // read the magic number
-  print_verbose(verbose, "\tReading the magic number...");
-  fscanf(file, "%c%c%c", &magicNumber[0], &magicNumber[1], &magicNumber[2]);
-  if (magicNumber[0] != 'Q' || magicNumber[1] != '1' || magicNumber[2] != '\n') {
+  for (size_t i = 0; i < numSubtrees; i++) {
+    unsigned char bytes[8];
+    if (fread(bytes, sizeof(unsigned char), 8, file) != 8) {
+      free(offsets);
+      freeQuadTree(*qt);
+      return -1;
+    }
+    offsets[i] = 0;
+    for (int b = 7; b >= 0; b--)
+      offsets[i] = (offsets[i] << 8) | bytes[b];
+  }
+  long start = ftell(file);
+  // the levels up to the index are needed by every subtree
+  readTopLevels(&src, *qt, indexLevel, h, &bitField, &bitCount);
+  if (readIndexedSubtrees(filename, *qt, indexLevel, offsets, start) == -1) {
+    free(offsets);
+    freeQuadTree(*qt);
     return -1;
   }
-  magicNumber[2] = '\0';
+  free(offsets);
+  return 0;
+}
+
+/// @brief Frees the comments read with a header, if the caller asked for them
+/// @param comments The comments of the image, NULL if they were skipped
+static void dropComments(char **comments) {
+  if (comments == NULL)
+    return;
+  free(*comments);
+  *comments = NULL;
+}
+
+/// @brief Reads the text header of the files of the first versions, after its
+/// magic number: comment lines, height and level of the subtree index
+/// @param file The file to read from, positioned after the magic number
+/// @param indexed 1 if the magic number is Q2, 0 if it is Q1
+/// @param comments The comments of the image, allocated if there are any, NULL
+/// to skip them
+/// @param h The height of the quadtree
+/// @param indexLevel The level of the subtree index, 0 if there is none
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the header was read successfully, -1 otherwise
+static int readLegacyHeader(FILE *file, int indexed, char **comments,
+                            unsigned char *h, unsigned char *indexLevel,
+                            int verbose) {
   // Save the position where comments start
   long comments_start = ftell(file);
 
@@ -172,37 +397,227 @@ int QTC_decoder(const char *filename, QuadTree **qt,
     }
   }
   // allocate memory for the comments only if there are any
-  if (commentsSize != 0) {
+  if (commentsSize != 0 && comments != NULL) {
     // Allocate the comments
     *comments = malloc(commentsSize + 1); // +1 for '\0'
     if (*comments == NULL) {
-      fclose(file);
       return -1;
     }
 
     // Second pass to read the comments block using fread
     // Go back to the start of the comments block
     if (fseek(file, comments_start, SEEK_SET) != 0) {
-      free(*comments);
-      fclose(file);
+      dropComments(comments);
       return -1;
     }
     // Read the comments block
     size_t bytesRead = fread(*comments, 1, commentsSize, file);
     if (bytesRead != commentsSize) {
-      free(*comments);
-      fclose(file);
+      dropComments(comments);
       return -1;
     }
     (*comments)[commentsSize] = '\0'; // Null-terminate the string
   }
   print_verbose(verbose, "\tReading the height of the quadtree...");
 
-  unsigned char h;
   // read the height of the quadtree
-  fread(&h, sizeof(unsigned char), 1, file);
+  if (fread(h, sizeof(unsigned char), 1, file) != 1 || *h == 0 ||
+      *h > QT_MAX_LEVELS) {
+    dropComments(comments);
+    return -1;
+  }
+  *indexLevel = 0;
+  if (indexed) {
+    print_verbose(verbose, "\tReading the subtree index...");
+    if (fread(indexLevel, sizeof(unsigned char), 1, file) != 1 ||
+        *indexLevel == 0 || *indexLevel >= *h ||
+        *indexLevel > QTC_MAX_INDEX_LEVEL) {
+      dropComments(comments);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/// @brief Reads an integer stored in little endian
+/// @param bytes The bytes of the integer
+/// @param n The number of bytes
+/// @return The integer
+static uint64_t loadLE(const unsigned char *bytes, int n) {
+  uint64_t value = 0;
+  for (int b = n - 1; b >= 0; b--)
+    value = (value << 8) | bytes[b];
+  return value;
+}
+
+/// @brief Parses and checks the fixed size header of a QTC file
+/// @param bytes The QTC_HEADER_SIZE bytes of the header
+/// @param header The parsed header
+/// @return 0 if the header is valid, -1 otherwise
+static int parseHeader(const unsigned char *bytes, QTCHeader *header) {
+  if (memcmp(bytes, QTC_MAGIC, 4) != 0)
+    return -1;
+  header->version = bytes[4];
+  header->depth = bytes[5];
+  header->levels = bytes[6];
+  header->indexLevel = bytes[7];
+  header->flags = (uint32_t)loadLE(bytes + 8, 4);
+  header->width = (uint32_t)loadLE(bytes + 12, 4);
+  header->height = (uint32_t)loadLE(bytes + 16, 4);
+  header->metadataSize = (uint32_t)loadLE(bytes + 20, 4);
+  header->payloadSize = loadLE(bytes + 24, 8);
+  // only square images of 8 bits per pixel are stored, the index must leave
+  // at least one level below it and the frames of a sequence have none
+  if (header->version != QTC_VERSION || header->depth != __CHAR_BIT__ ||
+      header->levels == 0 || header->levels > QT_MAX_LEVELS ||
+      header->width != (uint32_t)1 << header->levels ||
+      header->height != header->width ||
+      (header->flags & ~(uint32_t)(QTC_FLAG_INDEXED | QTC_FLAG_INTER)) != 0 ||
+      ((header->flags & QTC_FLAG_INDEXED) != 0) != (header->indexLevel != 0) ||
+      ((header->flags & QTC_FLAG_INTER) != 0 && header->indexLevel != 0) ||
+      header->indexLevel >= header->levels ||
+      header->indexLevel > QTC_MAX_INDEX_LEVEL)
+    return -1;
+  return 0;
+}
+
+/// @brief Reads the header of a QTC file: the fixed size header and the
+/// metadata, or the text header of the first versions
+/// @param file The file to read from
+/// @param comments The comments of the image, allocated if there are any, NULL
+/// to skip them
+/// @param h The height of the quadtree
+/// @param indexLevel The level of the subtree index, 0 if there is none
+/// @param inter 1 if the file must be a frame coded against the previous
+/// one, 0 if it must be a whole image
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the header was read successfully, -1 otherwise
+static int readHeader(FILE *file, char **comments, unsigned char *h,
+                      unsigned char *indexLevel, int inter, int verbose) {
+  unsigned char bytes[QTC_HEADER_SIZE];
+  print_verbose(verbose, "\tReading the header...");
+  if (fread(bytes, sizeof(unsigned char), 3, file) != 3)
+    return -1;
+  // Q1 and Q2 files start with a text header
+  if (bytes[0] == 'Q' && (bytes[1] == '1' || bytes[1] == '2') &&
+      bytes[2] == '\n' && !inter)
+    return readLegacyHeader(file, bytes[1] == '2', comments, h, indexLevel,
+                            verbose);
+  QTCHeader header;
+  if (fread(bytes + 3, sizeof(unsigned char), QTC_HEADER_SIZE - 3, file) !=
+          QTC_HEADER_SIZE - 3 ||
+      parseHeader(bytes, &header) == -1 ||
+      ((header.flags & QTC_FLAG_INTER) != 0) != (inter != 0))
+    return -1;
+  // the metadata are skipped with a single seek if the caller drops them
+  if (header.metadataSize != 0 && comments == NULL &&
+      fseek(file, header.metadataSize, SEEK_CUR) != 0)
+    return -1;
+  if (header.metadataSize != 0 && comments != NULL) {
+    *comments = malloc(header.metadataSize + 1);
+    if (*comments == NULL)
+      return -1;
+    if (fread(*comments, 1, header.metadataSize, file) !=
+        header.metadataSize) {
+      dropComments(comments);
+      return -1;
+    }
+    (*comments)[header.metadataSize] = '\0';
+  }
+  // a truncated file is rejected before its tree is allocated
+  long payload = ftell(file);
+  if (payload < 0 || fseek(file, 0, SEEK_END) != 0 ||
+      (uint64_t)(ftell(file) - payload) < header.payloadSize ||
+      fseek(file, payload, SEEK_SET) != 0) {
+    dropComments(comments);
+    return -1;
+  }
+  *h = header.levels;
+  *indexLevel = header.indexLevel;
+  return 0;
+}
+
+/// @brief Parses the header of a QTC file held in memory, see readHeader.
+/// Only whole images are accepted, not the frames of a sequence.
+/// @param data The content of the file
+/// @param size The size of the content
+/// @param header The parsed header, only levels and indexLevel for the files
+/// of the first versions
+/// @param metadata The position of the comments or metadata, metadataSize
+/// bytes long
+/// @param payload The position of the payload: the index, then the bitstream
+/// @return 0 if the header is valid and the payload inside the data, -1
+/// otherwise
+static int locateHeader(const unsigned char *data, size_t size,
+                        QTCHeader *header, size_t *metadata,
+                        size_t *payload) {
+  // the magic number, then the comment lines, as in readLegacyHeader
+  if (size >= 3 && data[0] == 'Q' && (data[1] == '1' || data[1] == '2') &&
+      data[2] == '\n') {
+    size_t i = 3;
+    while (i < size && data[i] == '#') {
+      while (i < size && data[i] != '\n')
+        i++;
+      i++;
+    }
+    if (i >= size || data[i] == 0 || data[i] > QT_MAX_LEVELS)
+      return -1;
+    *metadata = 3;
+    header->metadataSize = (uint32_t)(i - 3);
+    header->levels = data[i++];
+    header->indexLevel = 0;
+    if (data[1] == '2') {
+      if (i >= size || data[i] == 0 || data[i] >= header->levels ||
+          data[i] > QTC_MAX_INDEX_LEVEL)
+        return -1;
+      header->indexLevel = data[i++];
+    }
+    *payload = i;
+    return 0;
+  }
+  // the header gives the size of the whole file
+  if (size < QTC_HEADER_SIZE || parseHeader(data, header) == -1 ||
+      (header->flags & QTC_FLAG_INTER) != 0 ||
+      header->metadataSize > size - QTC_HEADER_SIZE ||
+      header->payloadSize > size - QTC_HEADER_SIZE - header->metadataSize)
+    return -1;
+  *metadata = QTC_HEADER_SIZE;
+  *payload = QTC_HEADER_SIZE + header->metadataSize;
+  return 0;
+}
+
+int QTC_readHeight(const unsigned char *data, size_t size, unsigned char *h) {
+  QTCHeader header;
+  size_t metadata, payload;
+  if (locateHeader(data, size, &header, &metadata, &payload) == -1)
+    return -1;
+  *h = header.levels;
+  return 0;
+}
+
+int QTC_decoder(const char *filename, QuadTree **qt,
+                         unsigned char *grayScale, char **comments,
+                         int verbose) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+
+  // verbose message
+  char message[100];
+  sprintf(message, "\x1b[1;32mDecoding file \x1b[0m \x1b[1;35m%s\x1b[0m",
+          filename);
+  print_verbose(verbose, message);
+
+  unsigned char h, indexLevel;
+  if (readHeader(file, comments, &h, &indexLevel, 0, verbose) == -1) {
+    fclose(file);
+    return -1;
+  }
   print_verbose(verbose, "\t\x1b[1;32mReading the quadtree...\x1b[0m");
-  if (readTree(qt, h, file, verbose) == -1) {
+  if (readTree(qt, h, indexLevel, filename, file, verbose) == -1) {
+    dropComments(comments);
+    fclose(file);
     return -1;
   }
   (*qt)->numLevels = h;
@@ -213,6 +628,162 @@ int QTC_decoder(const char *filename, QuadTree **qt,
   return 0;
 }
 
+/// @brief Reads the children of the expanded nodes [first, last) of a level
+/// of a SparseQuadTree, then theirs, down to the given level
+/// @param src The bitstream to read from
+/// @param sqt The SparseQuadTree to fill
+/// @param level The level of the nodes
+/// @param bottom The last level to read
+/// @param height The number of levels of the SparseQuadTree
+/// @param first The position of the first node in its level
+/// @param last The position following the last node in its level
+/// @param bitField The bitField holding the current byte being read
+/// @param bitCount The count of bits left in the bitField
+/// @return 0 if successful, -1 if a level could not grow
+static inline int readSparseLevels(BitSource *src, SparseQuadTree *sqt,
+                                   unsigned char level, unsigned char bottom,
+                                   unsigned char height, size_t first,
+                                   size_t last, unsigned char *bitField,
+                                   int *bitCount) {
+  for (; level < bottom; level++) {
+    size_t start = sqt->levels[level + 1].count;
+    // leaves are uniform with an error of 0
+    int leaf = level + 1 == height;
+    for (size_t pos = first; pos < last; pos++) {
+      Node parent = sqt->levels[level].nodes[pos];
+      // if the node is uniform and has an error of 0 its children are not
+      // stored
+      if (parent.e == 0 && parent.u == 1)
+        continue;
+      Node group[4];
+      readGroup(src, parent, group, leaf, bitField, bitCount);
+      if (appendSparseGroup(sqt, level + 1, group) == -1)
+        return -1;
+    }
+    // the next level starts with the children just read
+    first = start;
+    last = sqt->levels[level + 1].count;
+  }
+  return 0;
+}
+
+int QTC_decoderSparse(const char *filename, SparseQuadTree **sqt,
+                      unsigned char *grayScale, char **comments,
+                      int verbose) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+
+  char message[100];
+  sprintf(message, "\x1b[1;32mDecoding file \x1b[0m \x1b[1;35m%s\x1b[0m",
+          filename);
+  print_verbose(verbose, message);
+  int status = QTC_decoderSparseStream(file, sqt, grayScale, comments, verbose);
+  fclose(file);
+  return status;
+}
+
+/// @brief Reads a SparseQuadTree from its bitstream
+/// @param src The bitstream, positioned after the subtree index
+/// @param sqt The SparseQuadTree to create, or to read again if not NULL
+/// @param h The height of the quadtree
+/// @param indexLevel The level of the subtree index, 0 if there is none
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise
+/// @return 0 if the SparseQuadTree was read successfully, -1 otherwise
+static int readSparse(BitSource *src, SparseQuadTree **sqt, unsigned char h,
+                      unsigned char indexLevel, int verbose) {
+  char message[100];
+  print_verbose(verbose, "\t\x1b[1;32mReading the sparse quadtree...\x1b[0m");
+  // a tree given by the caller is emptied and kept on failure
+  int created = *sqt == NULL;
+  if (created)
+    *sqt = createSparseQuadTree(h);
+  if (*sqt == NULL || (!created && resetSparseQuadTree(*sqt, h) == -1))
+    return -1;
+  unsigned char bitField = 0;
+  int bitCount = 0;
+  unsigned char m;
+  // the root is always stored
+  readBits(src, &bitField, &bitCount, &m, __CHAR_BIT__);
+  Node root = {m, 1, 0};
+  readFlags(src, &root, &bitField, &bitCount);
+  int status = appendSparseNode(*sqt, 0, root);
+  if (status == 0 && indexLevel == 0) {
+    status = readSparseLevels(src, *sqt, 0, h, h, 0, 1, &bitField, &bitCount);
+  } else if (status == 0) {
+    // the subtrees of an indexed file are stored one after the other, so they
+    // are read sequentially without the offsets
+    status = readSparseLevels(src, *sqt, 0, indexLevel, h, 0, 1, &bitField,
+                              &bitCount);
+    for (size_t pos = 0;
+         status == 0 && pos < (*sqt)->levels[indexLevel].count; pos++)
+      status = readSparseLevels(src, *sqt, indexLevel, h, h, pos, pos + 1,
+                                &bitField, &bitCount);
+  }
+  if (status == -1 || finalizeSparseQuadTree(*sqt) == -1) {
+    if (created) {
+      freeSparseQuadTree(*sqt);
+      *sqt = NULL;
+    } else {
+      resetSparseQuadTree(*sqt, 0);
+    }
+    return -1;
+  }
+  sprintf(message, "\t\x1b[1;35m%zu\x1b[0m nodes stored out of %zu",
+          sparseNodeCount(*sqt), totalNodes(h));
+  print_verbose(verbose, message);
+  print_verbose(verbose, "\x1b[1;32mDecoding successful!\n\x1b[0m");
+  return 0;
+}
+
+int QTC_decoderSparseStream(FILE *file, SparseQuadTree **sqt,
+                            unsigned char *grayScale, char **comments,
+                            int verbose) {
+  unsigned char h, indexLevel;
+  if (readHeader(file, comments, &h, &indexLevel, 0, verbose) == -1)
+    return -1;
+  // the index is skipped, see readSparse
+  if (indexLevel > 0)
+    fseek(file, ((long)1 << (2 * indexLevel)) * 8, SEEK_CUR);
+  BitSource src = {file, NULL, NULL};
+  if (readSparse(&src, sqt, h, indexLevel, verbose) == -1) {
+    dropComments(comments);
+    return -1;
+  }
+  *grayScale = 255;
+  return 0;
+}
+
+int QTC_decoderSparseBuffer(const unsigned char *data, size_t size,
+                            SparseQuadTree **sqt, unsigned char *grayScale,
+                            char **comments, int verbose) {
+  QTCHeader header;
+  size_t metadata, payload;
+  print_verbose(verbose, "\tReading the header...");
+  if (locateHeader(data, size, &header, &metadata, &payload) == -1)
+    return -1;
+  // the index is skipped, see readSparse
+  size_t index =
+      header.indexLevel > 0 ? ((size_t)1 << (2 * header.indexLevel)) * 8 : 0;
+  if (index > size - payload)
+    return -1;
+  if (header.metadataSize != 0 && comments != NULL) {
+    *comments = malloc(header.metadataSize + 1);
+    if (*comments == NULL)
+      return -1;
+    memcpy(*comments, data + metadata, header.metadataSize);
+    (*comments)[header.metadataSize] = '\0';
+  }
+  BitSource src = {NULL, data + payload + index, data + size};
+  if (readSparse(&src, sqt, header.levels, header.indexLevel, verbose) == -1) {
+    dropComments(comments);
+    return -1;
+  }
+  *grayScale = 255;
+  return 0;
+}
+
 // Recursive helper function to fill the pixmap
 static void buildPixMap_aux(QuadTree *qt, unsigned char *pixmap, size_t width,
                             size_t x, size_t y, size_t nodeSize,
@@ -250,12 +821,12 @@ int buildPixMap(QuadTree *qt, unsigned char **pixmap, unsigned char h,
                 int verbose) {
   assert(qt != NULL);
   assert(h > 0);
-  size_t width = 1 << h;
+  size_t width = (size_t)1 << h;
 
   print_verbose(verbose, "\x1b[1;32mBuilding the pixmap...\x1b[0m");
 
   // Allocate memory for pixmap
-  *pixmap = (unsigned char *)malloc(width * width * sizeof(unsigned char));
+  *pixmap = (unsigned char *)largeAlloc(width * width * sizeof(unsigned char));
   if (*pixmap == NULL) {
     return -1;
   }
@@ -264,3 +835,138 @@ int buildPixMap(QuadTree *qt, unsigned char **pixmap, unsigned char h,
   print_verbose(verbose, "\x1b[1;32mPixmap built successfully!\n\x1b[0m");
   return 0;
 }
+
+/// @brief Frame of a sequence being read over the previous one
+typedef struct {
+  BitSource src;          // the bitstream of the file
+  unsigned char bitField; // the bitField holding the current byte being read
+  int bitCount;           // the count of bits left in the bitField
+  QuadTree *ref;          // the previous frame, updated in place
+  unsigned char *pixmap;  // the image of the previous frame, NULL if none
+  size_t changed;         // number of changed nodes read
+} InterFrame;
+
+/// @brief Sets a changed node of the reference and draws its block if it is
+/// uniform: its descendants take its intensity.
+/// @param frame The frame being read.
+/// @param node The changed node.
+/// @param index The index of the node.
+/// @param level The level of the node.
+/// @param x The column of the top left pixel of the block.
+/// @param y The row of the top left pixel of the block.
+/// @return 1 if the children of the node are stored, 0 otherwise.
+static int setChangedNode(InterFrame *frame, Node node, size_t index,
+                          unsigned char level, size_t x, size_t y) {
+  QuadTree *ref = frame->ref;
+  frame->changed++;
+  if (level < ref->numLevels && (node.e != 0 || node.u != 1)) {
+    ref->root[index] = node;
+    return 1;
+  }
+  fillUniform(ref, index, level, node.m);
+  if (frame->pixmap != NULL) {
+    size_t width = (size_t)1 << ref->numLevels;
+    size_t size = (size_t)1 << (ref->numLevels - level);
+    for (size_t row = y; row < y + size; row++)
+      memset(&frame->pixmap[row * width + x], node.m, size);
+  }
+  return 0;
+}
+
+/// @brief Reads the changed children of a changed node, then theirs, depth
+/// first, see QTC_encoderInter. The unchanged children keep the nodes of the
+/// reference.
+/// @param frame The frame being read.
+/// @param index The index of the changed node, already set in the reference.
+/// @param level The level of the changed node.
+/// @param x The column of the top left pixel of the block of the node.
+/// @param y The row of the top left pixel of the block of the node.
+static void readChangedChildren(InterFrame *frame, size_t index,
+                                unsigned char level, size_t x, size_t y) {
+  QuadTree *ref = frame->ref;
+  size_t first = 4 * index + 1;
+  int leaf = level + 1 == ref->numLevels;
+  unsigned char same;
+  readBits(&frame->src, &frame->bitField, &frame->bitCount, &same, 4);
+  Node parent = ref->root[index];
+  Node group[4];
+  unsigned int sum = 0;
+  for (int i = 0; i < 4; i++) {
+    int changed = !((same >> (3 - i)) & 1);
+    if (!changed) {
+      group[i] = ref->root[first + i];
+    } else if (i < 3) {
+      unsigned char m;
+      readBits(&frame->src, &frame->bitField, &frame->bitCount, &m,
+               __CHAR_BIT__);
+      group[i] = (Node){m, 1, 0};
+    } else {
+      // the intensity of the fourth child is implied, the unchanged ones are
+      // in the reference
+      group[3] = (Node){(4 * parent.m + parent.e) - sum, 1, 0};
+    }
+    if (changed && !leaf)
+      readFlags(&frame->src, &group[i], &frame->bitField, &frame->bitCount);
+    sum += group[i].m;
+  }
+  // order: TL, TR, BR, BL
+  size_t shift = (size_t)1 << (ref->numLevels - level - 1);
+  size_t dx[4] = {0, shift, shift, 0};
+  size_t dy[4] = {0, 0, shift, shift};
+  for (int i = 0; i < 4; i++)
+    if (!((same >> (3 - i)) & 1) &&
+        setChangedNode(frame, group[i], first + i, level + 1, x + dx[i],
+                       y + dy[i]))
+      readChangedChildren(frame, first + i, level + 1, x + dx[i], y + dy[i]);
+}
+
+int QTC_decoderInter(const char *filename, QuadTree *ref,
+                     unsigned char *pixmap, uint64_t *id, int verbose) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+  char message[150];
+  sprintf(message, "\x1b[1;32mDecoding frame \x1b[0m \x1b[1;35m%.80s\x1b[0m",
+          filename);
+  print_verbose(verbose, message);
+
+  unsigned char h, indexLevel;
+  unsigned char ids[QTC_FRAME_IDS_SIZE];
+  if (readHeader(file, NULL, &h, &indexLevel, 1, verbose) == -1 ||
+      h != ref->numLevels ||
+      fread(ids, sizeof(unsigned char), QTC_FRAME_IDS_SIZE, file) !=
+          QTC_FRAME_IDS_SIZE) {
+    fclose(file);
+    return -1;
+  }
+  // a frame drawn over another one than its reference would be garbage
+  if (loadLE(ids, 8) != *id) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: %s is not coded over the previous "
+            "frame\n",
+            filename);
+    fclose(file);
+    return -1;
+  }
+  *id = loadLE(ids + 8, 8);
+  InterFrame frame = {{file, NULL, NULL}, 0, 0, ref, pixmap, 0};
+  unsigned char same;
+  // an unchanged frame is a single bit
+  readBits(&frame.src, &frame.bitField, &frame.bitCount, &same, 1);
+  if (!same) {
+    unsigned char m;
+    readBits(&frame.src, &frame.bitField, &frame.bitCount, &m, __CHAR_BIT__);
+    Node root = {m, 1, 0};
+    if (h > 0)
+      readFlags(&frame.src, &root, &frame.bitField, &frame.bitCount);
+    if (setChangedNode(&frame, root, 0, 0, 0, 0))
+      readChangedChildren(&frame, 0, 0, 0, 0);
+  }
+  fclose(file);
+  sprintf(message, "\t\x1b[1;35m%zu\x1b[0m changed nodes out of %zu",
+          frame.changed, totalNodes(h));
+  print_verbose(verbose, message);
+  print_verbose(verbose, "\x1b[1;32mDecoding successful!\n\x1b[0m");
+  return 0;
+}
@@ -23,7 +23,8 @@ void name_output_file(int flag_o, char *output, char *filename_out,
   // choose correct directory
   if (strcmp(extension, ".qtc") == 0) {
     strcpy(filename_out, "QTC/");
-  } else if (strcmp(extension, ".pgm") == 0) {
+  } else if (strcmp(extension, ".pgm") == 0 ||
+             strcmp(extension, ".txt") == 0) {
     strcpy(filename_out, "PGM/");
   } else {
     fprintf(stderr, "\x1b[1;31mError\x1b[0m: extension not recognized\n");
@@ -0,0 +1,126 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+// MAP_ANONYMOUS and madvise are not part of C17
+#define _DEFAULT_SOURCE
+
+#include "large_alloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+// size of a huge page, buffers smaller than that are always allocated by malloc
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+// size of the header stored before each buffer, keeps the cache line
+// alignment of the mappings
+#define HEADER_SIZE 64
+
+// how a buffer was allocated
+#define KIND_MALLOC 0
+#define KIND_MAPPED 1
+
+typedef struct {
+  size_t length; // length of the mapping, header included
+  int kind;
+} Header;
+
+static int allocMode = ALLOC_DEFAULT;
+
+void setAllocMode(int mode) { allocMode = mode; }
+
+/// @brief Maps anonymous memory backed by huge pages if possible.
+/// @param length The length of the mapping, a multiple of HUGE_PAGE_SIZE.
+/// @return The mapping, NULL if no memory could be mapped.
+static void *mapHugePages(size_t length) {
+  void *base;
+#ifdef MAP_HUGETLB
+  // reserved huge pages first
+  base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (base != MAP_FAILED)
+    return base;
+#endif
+  // then transparent huge pages, the mapping is usable even if the kernel
+  // ignores the advice
+  base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+              -1, 0);
+  if (base == MAP_FAILED)
+    return NULL;
+#ifdef MADV_HUGEPAGE
+  madvise(base, length, MADV_HUGEPAGE);
+#endif
+  return base;
+}
+
+/// @brief Allocates a buffer and its header.
+/// @param size The size of the buffer in bytes.
+/// @param zero 1 if the buffer must be zeroed, 0 otherwise.
+/// @return The buffer, NULL if the allocation failed.
+static void *allocate(size_t size, int zero) {
+  if (size > SIZE_MAX - 2 * HUGE_PAGE_SIZE)
+    return NULL;
+  size_t length = size + HEADER_SIZE;
+  Header *header = NULL;
+
+  if (allocMode == ALLOC_HUGEPAGES && length >= HUGE_PAGE_SIZE) {
+    // anonymous mappings are already zeroed
+    length = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    header = (Header *)mapHugePages(length);
+    if (header != NULL) {
+      header->length = length;
+      header->kind = KIND_MAPPED;
+      return (unsigned char *)header + HEADER_SIZE;
+    }
+    length = size + HEADER_SIZE;
+  }
+
+  header = (Header *)(zero ? calloc(1, length) : malloc(length));
+  if (header == NULL)
+    return NULL;
+  header->length = length;
+  header->kind = KIND_MALLOC;
+  return (unsigned char *)header + HEADER_SIZE;
+}
+
+void *largeAlloc(size_t size) { return allocate(size, 0); }
+
+void *largeCalloc(size_t count, size_t size) {
+  if (size != 0 && count > SIZE_MAX / size)
+    return NULL;
+  return allocate(count * size, 1);
+}
+
+void *largeShrink(void *ptr, size_t size) {
+  Header *header = (Header *)((unsigned char *)ptr - HEADER_SIZE);
+  size_t length = size + HEADER_SIZE;
+
+  if (header->kind == KIND_MALLOC) {
+    Header *shrunk = (Header *)realloc(header, length);
+    if (shrunk == NULL)
+      return ptr;
+    shrunk->length = length;
+    return (unsigned char *)shrunk + HEADER_SIZE;
+  }
+
+  // give back the huge pages past the end of the buffer
+  length = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  if (length < header->length &&
+      munmap((unsigned char *)header + length, header->length - length) == 0)
+    header->length = length;
+  return ptr;
+}
+
+void largeFree(void *ptr) {
+  if (ptr == NULL)
+    return;
+  Header *header = (Header *)((unsigned char *)ptr - HEADER_SIZE);
+  if (header->kind == KIND_MAPPED)
+    munmap(header, header->length);
+  else
+    free(header);
+}
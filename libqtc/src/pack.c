@@ -0,0 +1,391 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+// mmap is not part of C17
+#define _POSIX_C_SOURCE 200809L
+
+#include "qtc.h"
+#include "decoder.h"
+#include "file_naming.h"
+#include "verbose.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define PACK_VERSION 1
+#define PACK_HEADER_SIZE 24
+#define PACK_ENTRY_SIZE 64
+
+/// @brief Header at the start of a pack. The contents of the entries follow
+/// it, each padded to 8 bytes, then the index holds one PackEntry per entry.
+/// The integers of the header and of the index are stored in little endian.
+typedef struct {
+  char magic[4];        // "QPK1"
+  uint32_t version;     // PACK_VERSION
+  uint64_t count;       // number of entries
+  uint64_t indexOffset; // position of the index, after the contents
+} PackHeader;
+
+/// @brief Stores an integer in little endian.
+/// @param bytes The bytes to fill.
+/// @param value The integer.
+/// @param n The number of bytes.
+static void storeLE(unsigned char *bytes, uint64_t value, int n) {
+  for (int b = 0; b < n; b++)
+    bytes[b] = (value >> (8 * b)) & 0xFF;
+}
+
+/// @brief Reads an integer stored in little endian.
+/// @param bytes The bytes of the integer.
+/// @param n The number of bytes.
+/// @return The integer.
+static uint64_t loadLE(const unsigned char *bytes, int n) {
+  uint64_t value = 0;
+  for (int b = n - 1; b >= 0; b--)
+    value = (value << 8) | bytes[b];
+  return value;
+}
+
+/// @brief Fills the PACK_HEADER_SIZE bytes of a header.
+/// @param bytes The bytes to fill.
+/// @param header The header.
+static void storePackHeader(unsigned char *bytes, const PackHeader *header) {
+  memcpy(bytes, header->magic, 4);
+  storeLE(bytes + 4, header->version, 4);
+  storeLE(bytes + 8, header->count, 8);
+  storeLE(bytes + 16, header->indexOffset, 8);
+}
+
+/// @brief Reads the PACK_HEADER_SIZE bytes of a header.
+/// @param bytes The bytes of the header.
+/// @param header The header to fill.
+static void loadPackHeader(const unsigned char *bytes, PackHeader *header) {
+  memcpy(header->magic, bytes, 4);
+  header->version = (uint32_t)loadLE(bytes + 4, 4);
+  header->count = loadLE(bytes + 8, 8);
+  header->indexOffset = loadLE(bytes + 16, 8);
+}
+
+/// @brief Fills the PACK_ENTRY_SIZE bytes of an entry of the index.
+/// @param bytes The bytes to fill.
+/// @param entry The entry.
+static void storePackEntry(unsigned char *bytes, const PackEntry *entry) {
+  storeLE(bytes, entry->offset, 8);
+  storeLE(bytes + 8, entry->size, 8);
+  storeLE(bytes + 16, entry->width, 4);
+  memcpy(bytes + 20, entry->name, PACK_NAME_SIZE);
+}
+
+/// @brief Reads the PACK_ENTRY_SIZE bytes of an entry of the index.
+/// @param bytes The bytes of the entry.
+/// @param entry The entry to fill.
+static void loadPackEntry(const unsigned char *bytes, PackEntry *entry) {
+  entry->offset = loadLE(bytes, 8);
+  entry->size = loadLE(bytes + 8, 8);
+  entry->width = (uint32_t)loadLE(bytes + 16, 4);
+  memcpy(entry->name, bytes + 20, PACK_NAME_SIZE);
+}
+
+/// @brief Checks the header of a pack.
+/// @param header The header.
+/// @param length The size of the pack.
+/// @return 0 if the header is valid and its index inside the pack, -1
+/// otherwise.
+static int checkPackHeader(const PackHeader *header, size_t length) {
+  if (memcmp(header->magic, "QPK1", 4) != 0 ||
+      header->version != PACK_VERSION ||
+      header->indexOffset < PACK_HEADER_SIZE ||
+      header->indexOffset % 8 != 0 || header->indexOffset > length ||
+      header->count > (length - header->indexOffset) / PACK_ENTRY_SIZE)
+    return -1;
+  return 0;
+}
+
+/// @brief Checks the name of an entry read from a pack, as nameEntry would
+/// have made it: the entries are extracted under this name, which must not
+/// lead out of the output directory.
+/// @param name The name of the entry, ended by '\0'.
+/// @return 0 if the name is valid, -1 otherwise.
+static int checkEntryName(const char *name) {
+  if (name[0] == '\0' || strchr(name, '/') != NULL ||
+      strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+    return -1;
+  return 0;
+}
+
+/// @brief Names an entry after its file: without directory and extension.
+/// @param filename The name of the file.
+/// @param name The name of the entry.
+/// @return 0 if successful, -1 if the name is too long.
+static int nameEntry(const char *filename, char name[PACK_NAME_SIZE]) {
+  const char *slash = strrchr(filename, '/');
+  const char *base = slash == NULL ? filename : slash + 1;
+  const char *dot = strrchr(base, '.');
+  size_t n = dot == NULL || dot == base ? strlen(base) : (size_t)(dot - base);
+  if (n == 0 || n >= PACK_NAME_SIZE)
+    return -1;
+  memset(name, 0, PACK_NAME_SIZE);
+  memcpy(name, base, n);
+  return 0;
+}
+
+/// @brief Appends the content of a .qtc file at the current position of a
+/// pack, padded to 8 bytes.
+/// @param file The pack.
+/// @param input The name of the .qtc file.
+/// @param entry The entry to fill, its offset is the current position.
+/// @param buffer The buffer receiving the content, kept from one file to the
+/// next.
+/// @param capacity The size of the buffer.
+/// @return 0 if successful, -1 otherwise.
+static int appendEntry(FILE *file, const char *input, PackEntry *entry,
+                       unsigned char **buffer, size_t *capacity) {
+  if (nameEntry(input, entry->name) == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: the name of %s must have 1 to "
+                    "%d characters\n",
+            input, PACK_NAME_SIZE - 1);
+    return -1;
+  }
+  FILE *in = fopen(input, "rb");
+  long len = -1;
+  if (in != NULL && fseek(in, 0, SEEK_END) == 0)
+    len = ftell(in);
+  // the buffer only grows, so small files do not allocate
+  if (len > 0 && (size_t)len > *capacity) {
+    unsigned char *grown = realloc(*buffer, len);
+    if (grown != NULL) {
+      *buffer = grown;
+      *capacity = len;
+    }
+  }
+  unsigned char h;
+  int status = len > 0 && (size_t)len <= *capacity &&
+                       fseek(in, 0, SEEK_SET) == 0 &&
+                       fread(*buffer, 1, len, in) == (size_t)len &&
+                       QTC_readHeight(*buffer, len, &h) == 0
+                   ? 0
+                   : -1;
+  if (in != NULL)
+    fclose(in);
+  if (status == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: %s is not a readable .qtc file\n",
+            input);
+    return -1;
+  }
+  static const unsigned char padding[8] = {0};
+  size_t pad = (8 - len % 8) % 8;
+  if (fwrite(*buffer, 1, len, file) != (size_t)len ||
+      fwrite(padding, 1, pad, file) != pad)
+    return -1;
+  entry->size = len;
+  entry->width = (uint32_t)1 << h;
+  return 0;
+}
+
+int packFiles(const char *pack, char **inputs, size_t count, int verbose) {
+  // an existing pack is appended to: the new contents overwrite its index,
+  // which is written again after them
+  PackHeader header = {{'Q', 'P', 'K', '1'}, PACK_VERSION, 0,
+                       PACK_HEADER_SIZE};
+  PackEntry *entries = NULL;
+  unsigned char bytes[PACK_ENTRY_SIZE];
+  FILE *file = fopen(pack, "r+b");
+  if (file != NULL) {
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+      length = ftell(file);
+    int valid = length >= 0 && fseek(file, 0, SEEK_SET) == 0 &&
+                fread(bytes, PACK_HEADER_SIZE, 1, file) == 1;
+    if (valid)
+      loadPackHeader(bytes, &header);
+    if (!valid || checkPackHeader(&header, length) == -1) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s is not a pack\n", pack);
+      fclose(file);
+      return -1;
+    }
+  } else {
+    file = fopen(pack, "w+b");
+    if (file == NULL) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be created\n",
+              pack);
+      return -1;
+    }
+  }
+  entries = (PackEntry *)malloc((header.count + count) * sizeof(PackEntry));
+  int valid = entries != NULL && fseek(file, header.indexOffset, SEEK_SET) == 0;
+  for (size_t i = 0; valid && i < header.count; i++) {
+    valid = fread(bytes, PACK_ENTRY_SIZE, 1, file) == 1;
+    if (valid)
+      loadPackEntry(bytes, &entries[i]);
+  }
+  if (!valid || fseek(file, header.indexOffset, SEEK_SET) != 0) {
+    free(entries);
+    fclose(file);
+    return -1;
+  }
+
+  char message[300];
+  unsigned char *buffer = NULL;
+  size_t capacity = 0;
+  uint64_t offset = header.indexOffset;
+  int status = 0;
+  for (size_t i = 0; i < count && status == 0; i++) {
+    PackEntry *entry = &entries[header.count + i];
+    entry->offset = offset;
+    status = appendEntry(file, inputs[i], entry, &buffer, &capacity);
+    offset += (entry->size + 7) / 8 * 8;
+    if (status == 0) {
+      sprintf(message, "Packed \x1b[1;35m%.200s\x1b[0m", inputs[i]);
+      print_verbose(verbose, message);
+    }
+  }
+  free(buffer);
+
+  // the header is written last. If an entry failed, the previous index is
+  // written back where it was, so the pack keeps its previous entries.
+  if (status == 0) {
+    header.count += count;
+    header.indexOffset = offset;
+  }
+  int written = fseek(file, header.indexOffset, SEEK_SET) == 0;
+  for (size_t i = 0; written && i < header.count; i++) {
+    storePackEntry(bytes, &entries[i]);
+    written = fwrite(bytes, PACK_ENTRY_SIZE, 1, file) == 1;
+  }
+  storePackHeader(bytes, &header);
+  written = written && fseek(file, 0, SEEK_SET) == 0 &&
+            fwrite(bytes, PACK_HEADER_SIZE, 1, file) == 1;
+  free(entries);
+  if (fclose(file) != 0 || !written) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be written\n",
+            pack);
+    return -1;
+  }
+  return status;
+}
+
+int openPack(const char *pack, PackFile *packFile) {
+  FILE *file = fopen(pack, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be opened\n",
+            pack);
+    return -1;
+  }
+  long length = -1;
+  if (fseek(file, 0, SEEK_END) == 0)
+    length = ftell(file);
+  void *base = MAP_FAILED;
+  if (length >= PACK_HEADER_SIZE)
+    base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  // the mapping stays valid once the file is closed
+  fclose(file);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s is not a pack\n", pack);
+    return -1;
+  }
+
+  // the whole index is read and checked once, the lookups then trust it
+  PackHeader header;
+  loadPackHeader((const unsigned char *)base, &header);
+  int status = checkPackHeader(&header, length);
+  PackEntry *entries = NULL;
+  if (status == 0) {
+    // one more byte, so an empty index is not mistaken for a failure
+    entries = (PackEntry *)malloc(header.count * sizeof(PackEntry) + 1);
+    status = entries == NULL ? -1 : 0;
+  }
+  for (size_t i = 0; status == 0 && i < header.count; i++) {
+    loadPackEntry((const unsigned char *)base + header.indexOffset +
+                      i * PACK_ENTRY_SIZE,
+                  &entries[i]);
+    if (entries[i].offset < PACK_HEADER_SIZE ||
+        entries[i].offset > header.indexOffset ||
+        entries[i].size > header.indexOffset - entries[i].offset ||
+        entries[i].name[PACK_NAME_SIZE - 1] != '\0' ||
+        checkEntryName(entries[i].name) == -1)
+      status = -1;
+  }
+  if (status == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s is not a pack\n", pack);
+    free(entries);
+    munmap(base, length);
+    return -1;
+  }
+  packFile->base = (const unsigned char *)base;
+  packFile->length = length;
+  packFile->entries = entries;
+  packFile->count = header.count;
+  return 0;
+}
+
+void closePack(PackFile *packFile) {
+  if (packFile->base != NULL)
+    munmap((void *)packFile->base, packFile->length);
+  free(packFile->entries);
+  packFile->base = NULL;
+  packFile->entries = NULL;
+  packFile->count = 0;
+}
+
+int findPackEntry(const PackFile *packFile, const char *name, size_t *id) {
+  // the last entry of a name is the most recent one
+  for (size_t i = packFile->count; i > 0; i--)
+    if (strcmp(packFile->entries[i - 1].name, name) == 0) {
+      *id = i - 1;
+      return 0;
+    }
+  return -1;
+}
+
+int decodePackEntry(const PackFile *packFile, size_t id, unsigned char **pgm,
+                    size_t *pgmSize, int verbose) {
+  if (id >= packFile->count)
+    return -1;
+  const PackEntry *entry = &packFile->entries[id];
+  return decodeMemory(packFile->base + entry->offset, entry->size, pgm,
+                      pgmSize, verbose);
+}
+
+int unpackFiles(const char *pack, int decode, int verbose) {
+  PackFile packFile;
+  if (openPack(pack, &packFile) == -1)
+    return -1;
+  int status = 0;
+  for (size_t id = 0; id < packFile.count && status == 0; id++) {
+    const PackEntry *entry = &packFile.entries[id];
+    const unsigned char *data = packFile.base + entry->offset;
+    size_t size = entry->size;
+    unsigned char *pgm = NULL;
+    if (decode && decodePackEntry(&packFile, id, &pgm, &size, verbose) == -1) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: entry %s could not be "
+                      "decoded\n",
+              entry->name);
+      status = -1;
+      break;
+    }
+    // QTC/<name>.qtc, or PGM/<name>.pgm once decoded
+    char name[PACK_NAME_SIZE];
+    char filename_out[PACK_NAME_SIZE + 8];
+    memcpy(name, entry->name, PACK_NAME_SIZE);
+    name_output_file(1, name, filename_out, decode ? ".pgm" : ".qtc", verbose,
+                     0);
+    FILE *file = fopen(filename_out, "wb");
+    if (file == NULL ||
+        fwrite(decode ? pgm : data, 1, size, file) != size) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be written\n",
+              filename_out);
+      status = -1;
+    }
+    if (file != NULL && fclose(file) != 0)
+      status = -1;
+    free(pgm);
+  }
+  closePack(&packFile);
+  return status;
+}
@@ -0,0 +1,36 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#include "parallel.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+size_t parallelThreads(size_t maxThreads) {
+  long numCPU = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t numThreads = numCPU < 1 ? 1 : (size_t)numCPU;
+  if (numThreads > maxThreads)
+    numThreads = maxThreads;
+  return numThreads < 1 ? 1 : numThreads;
+}
+
+void runParallel(void *(*fn)(void *), void *jobs, size_t jobSize, size_t n) {
+  if (n == 0)
+    return;
+  unsigned char *job = (unsigned char *)jobs;
+  pthread_t threads[n];
+  for (size_t t = 0; t < n; t++) {
+    // the last job is done by the current thread
+    if (t == n - 1 ||
+        pthread_create(&threads[t], NULL, fn, job + t * jobSize) != 0) {
+      fn(job + t * jobSize);
+      threads[t] = pthread_self();
+    }
+  }
+  for (size_t t = 0; t < n; t++)
+    if (!pthread_equal(threads[t], pthread_self()))
+      pthread_join(threads[t], NULL);
+}
@@ -4,99 +4,277 @@
   Modified:    10/12/2024
   =========================================== */
 
+// ftruncate and mmap are not part of C17, madvise not even of POSIX
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
 #include "pgm_io.h"
+#include "large_alloc.h"
 
 #include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
-int readPGM(const char *filename, unsigned char **pixmap, size_t *width,
-            size_t *height, unsigned char *grayScale, int verbose) {
+/// @brief Cursor over an in-memory copy of a netpbm file.
+typedef struct {
+  unsigned char *cur;
+  unsigned char *end;
+} Parser;
 
-  assert(filename != NULL);
+static int isSpace(unsigned char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
 
-  // verbose message
-  char message[100];
-  sprintf(message, "\x1b[1;32mReading PGM file:\x1b[0m \x1b[1;35m%s\x1b[0m",
-          filename);
-  print_verbose(verbose, message);
+/// @brief Skips whitespaces and '#' comments (up to the end of the line).
+/// @param p The parser.
+static void skipSpaces(Parser *p) {
+  while (p->cur < p->end) {
+    if (*p->cur == '#') {
+      while (p->cur < p->end && *p->cur != '\n')
+        p->cur++;
+    } else if (isSpace(*p->cur)) {
+      p->cur++;
+    } else {
+      return;
+    }
+  }
+}
 
-  FILE *file = fopen(filename, "rb");
-  if (file == NULL)
+/// @brief Parses an unsigned decimal integer, leading whitespaces and
+/// comments are skipped.
+/// @param p The parser.
+/// @param value The parsed value.
+/// @return 0 if an integer was parsed, -1 otherwise.
+static int parseUInt(Parser *p, size_t *value) {
+  skipSpaces(p);
+  if (p->cur == p->end || (unsigned)(*p->cur - '0') > 9)
     return -1;
+  size_t v = 0;
+  do {
+    size_t digit = *p->cur - '0';
+    // a value past SIZE_MAX would wrap to another one
+    if (v > (SIZE_MAX - digit) / 10)
+      return -1;
+    v = v * 10 + digit;
+    p->cur++;
+  } while (p->cur < p->end && (unsigned)(*p->cur - '0') <= 9);
+  *value = v;
+  return 0;
+}
 
-  print_verbose(verbose, "\tReading the magic number...");
-  char magicNumber[3];
-  if (fscanf(file, "%s\n", magicNumber) != 1) {
-    fclose(file);
-    return -1;
+/// @brief Reads the next header token of a PAM file (word or number).
+/// @param p The parser.
+/// @param token Buffer receiving the token.
+/// @param size Size of the buffer.
+/// @return 0 if a token was read, -1 otherwise.
+static int parseToken(Parser *p, char *token, size_t size) {
+  skipSpaces(p);
+  size_t n = 0;
+  while (p->cur < p->end && !isSpace(*p->cur)) {
+    if (n + 1 >= size)
+      return -1;
+    token[n++] = *p->cur++;
   }
-  magicNumber[2] = '\0';
+  token[n] = '\0';
+  return n == 0 ? -1 : 0;
+}
 
-  if (magicNumber[0] != 'P' || magicNumber[1] != '5') {
-    fclose(file);
+/// @brief Parses the header of a P2/P5 file (after the magic number).
+/// @return 0 if the header is valid, -1 otherwise.
+static int parseHeaderPGM(Parser *p, size_t *w, size_t *h, size_t *g) {
+  if (parseUInt(p, w) || parseUInt(p, h) || parseUInt(p, g))
     return -1;
+  return 0;
+}
+
+/// @brief Parses the header of a P7 (PAM) file (after the magic number).
+/// Only single channel images are accepted.
+/// @return 0 if the header is valid, -1 otherwise.
+static int parseHeaderPAM(Parser *p, size_t *w, size_t *h, size_t *g) {
+  char token[32];
+  size_t depth = 1;
+  *w = *h = *g = 0;
+  for (;;) {
+    if (parseToken(p, token, sizeof(token)) == -1)
+      return -1;
+    if (strcmp(token, "ENDHDR") == 0)
+      break;
+    if (strcmp(token, "WIDTH") == 0) {
+      if (parseUInt(p, w) == -1)
+        return -1;
+    } else if (strcmp(token, "HEIGHT") == 0) {
+      if (parseUInt(p, h) == -1)
+        return -1;
+    } else if (strcmp(token, "DEPTH") == 0) {
+      if (parseUInt(p, &depth) == -1)
+        return -1;
+    } else if (strcmp(token, "MAXVAL") == 0) {
+      if (parseUInt(p, g) == -1)
+        return -1;
+    } else if (strcmp(token, "TUPLTYPE") == 0) {
+      // the tuple type is informative, skip the rest of the line
+      while (p->cur < p->end && *p->cur != '\n')
+        p->cur++;
+    } else {
+      return -1;
+    }
   }
+  return depth == 1 ? 0 : -1;
+}
 
-  // Skip comments
-  // If the first character is a '#', we skip the line
-  for (char c = fgetc(file); c == '#' && c != EOF; c = fgetc(file)) {
-    char d;
-    while ((d = fgetc(file)) != '\n' && d != EOF)
-      ;
+/// @brief Reads a whole file in memory.
+/// @param file The file to read.
+/// @param size The size of the file.
+/// @return The content of the file, NULL on failure.
+static unsigned char *readFile(FILE *file, size_t *size) {
+  if (fseek(file, 0, SEEK_END) != 0)
+    return NULL;
+  long len = ftell(file);
+  if (len <= 0 || fseek(file, 0, SEEK_SET) != 0)
+    return NULL;
+  unsigned char *buffer = (unsigned char *)largeAlloc(len);
+  if (buffer == NULL)
+    return NULL;
+  if (fread(buffer, 1, len, file) != (size_t)len) {
+    largeFree(buffer);
+    return NULL;
   }
+  *size = len;
+  return buffer;
+}
 
-  // Go back one character because we read one character too many in the loop
-  fseek(file, -1, SEEK_CUR);
-  // Read the width and height of the pixmap
-  size_t w, h;
-  if (fscanf(file, "%zu %zu", &w, &h) != 2 || w <= 0 || h <= 0) {
-    fclose(file);
+/// @brief Parses a whole PGM file, the pixmap is built in place at the start
+/// of its content.
+/// @param buffer The content of the file, overwritten by the pixmap.
+/// @param size The size of the file.
+/// @param width pointer to the width of the image.
+/// @param height pointer to the height of the image.
+/// @param grayScale Maximum grayscale value.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the parsing was successful, -1 otherwise.
+static int parseInPlace(unsigned char *buffer, size_t size, size_t *width,
+                        size_t *height, unsigned char *grayScale,
+                        int verbose) {
+  char message[100];
+  if (size < 2)
+    return -1;
+  Parser p = {buffer + 2, buffer + size};
+
+  print_verbose(verbose, "\tReading the magic number...");
+  char format = buffer[1];
+  if (buffer[0] != 'P' || (format != '2' && format != '5' && format != '7'))
     return -1;
-  }
 
-  print_verbose(verbose, "\tReading the grayscale value...");
-  // Read the grayscale value
-  size_t g;
-  if (fscanf(file, "%zu", &g) != 1 || g != 255) {
-    fclose(file);
+  // Read the width, height and grayscale value of the pixmap
+  size_t w, h, g;
+  int status = format == '7' ? parseHeaderPAM(&p, &w, &h, &g)
+                             : parseHeaderPGM(&p, &w, &h, &g);
+  if (status == -1 || w == 0 || h == 0 || h > SIZE_MAX / w || g != 255)
     return -1;
-  }
 
   sprintf(message,
           "\tAllocating memory for the pixmap: \x1b[1;35m%zux%zu\x1b[0m", w, h);
   print_verbose(verbose, message);
 
-  unsigned char *pixmp = (unsigned char *)malloc(w * h);
-  if (pixmp == NULL) {
-    fclose(file);
-    return -1;
+  print_verbose(verbose, "\tReading the pixmap data...");
+  size_t numPixels = w * h;
+  if (format == '2') {
+    // every value takes at least two characters (digit and separator), so
+    // the pixels can be written behind the cursor in the same buffer
+    for (size_t i = 0; i < numPixels; i++) {
+      size_t value;
+      if (parseUInt(&p, &value) == -1 || value > g)
+        return -1;
+      buffer[i] = (unsigned char)value;
+    }
+  } else {
+    // a single whitespace separates the header from the binary data in P5,
+    // ENDHDR is followed by a newline in P7
+    if (p.cur == p.end || !isSpace(*p.cur) ||
+        (size_t)(p.end - p.cur - 1) < numPixels)
+      return -1;
+    memmove(buffer, p.cur + 1, numPixels);
   }
 
-  // skip the newline character
-  if (fgetc(file) == EOF) {
-    fclose(file);
+  *width = w;
+  *height = h;
+  *grayScale = g;
+
+  print_verbose(verbose, "\x1b[1;32mReading successful!\n\x1b[0m");
+  return 0;
+}
+
+/// @brief Parses a whole PGM file, the pixmap is built in place.
+/// @param buffer The content of the file, allocated by largeAlloc. It becomes
+/// the pixmap, or is freed if the parsing fails.
+/// @param size The size of the file.
+/// @param pixmap pointer to the image data.
+/// @param width pointer to the width of the image.
+/// @param height pointer to the height of the image.
+/// @param grayScale Maximum grayscale value.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the parsing was successful, -1 otherwise.
+static int parsePGM(unsigned char *buffer, size_t size, unsigned char **pixmap,
+                    size_t *width, size_t *height, unsigned char *grayScale,
+                    int verbose) {
+  if (buffer == NULL ||
+      parseInPlace(buffer, size, width, height, grayScale, verbose) == -1) {
+    largeFree(buffer);
     return -1;
   }
+  // give back the memory used by the header and the ASCII data
+  *pixmap = (unsigned char *)largeShrink(buffer, *width * *height);
+  return 0;
+}
+
+int readPGM(const char *filename, unsigned char **pixmap, size_t *width,
+            size_t *height, unsigned char *grayScale, int verbose) {
 
-  print_verbose(verbose, "\tReading pixmap width and height...");
+  assert(filename != NULL);
 
-  // reads the pixmap data
-  if (fread(pixmp, 1, w * h, file) != w * h) {
-    free(pixmp);
-    fclose(file);
+  // verbose message
+  char message[100];
+  sprintf(message, "\x1b[1;32mReading PGM file:\x1b[0m \x1b[1;35m%s\x1b[0m",
+          filename);
+  print_verbose(verbose, message);
+
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
     return -1;
-  }
+
+  // the whole file is loaded at once, the pixmap is then built in place
+  size_t size = 0;
+  unsigned char *buffer = readFile(file, &size);
   fclose(file);
+  return parsePGM(buffer, size, pixmap, width, height, grayScale, verbose);
+}
 
-  *pixmap = pixmp;
-  *width = w;
-  *height = h;
-  *grayScale = g;
+int readPGMMemory(const unsigned char *data, size_t size,
+                  unsigned char **pixmap, size_t *width, size_t *height,
+                  unsigned char *grayScale, int verbose) {
+  assert(data != NULL || size == 0);
+  print_verbose(verbose, "\x1b[1;32mReading PGM data...\x1b[0m");
 
-  print_verbose(verbose, "\x1b[1;32mReading successful!\n\x1b[0m");
-  return 0;
+  // the data is copied since the pixmap is built in place
+  unsigned char *buffer = (unsigned char *)largeAlloc(size);
+  if (buffer != NULL && size > 0)
+    memcpy(buffer, data, size);
+  return parsePGM(buffer, size, pixmap, width, height, grayScale, verbose);
+}
+
+int readPGMInPlace(unsigned char *data, size_t size, size_t *width,
+                   size_t *height, unsigned char *grayScale, int verbose) {
+  assert(data != NULL || size == 0);
+  print_verbose(verbose, "\x1b[1;32mReading PGM data in place...\x1b[0m");
+  return parseInPlace(data, size, width, height, grayScale, verbose);
 }
 
 int writePGM(const char *filename, unsigned char *pixmap, size_t width,
@@ -113,7 +291,21 @@ int writePGM(const char *filename, unsigned char *pixmap, size_t width,
   if (file == NULL) {
     return -1;
   }
+  int status = writePGMStream(file, pixmap, width, grayScale, comments, verbose);
+  fclose(file);
+
+  print_verbose(verbose, "\x1b[1;32mSaving the file...\n\x1b[0m");
+  return status;
+}
 
+/// @brief Writes the header of a binary PGM image.
+/// @param file stream to write to.
+/// @param width width of the image.
+/// @param grayScale Maximum grayscale value.
+/// @param comments Comments to write in the file.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+static void writeHeaderPGM(FILE *file, size_t width, unsigned char grayScale,
+                           char *comments, int verbose) {
   print_verbose(verbose, "\tWriting the magic number...");
   // Write the magic number
   fprintf(file, "P5\n");
@@ -130,15 +322,105 @@ int writePGM(const char *filename, unsigned char *pixmap, size_t width,
   print_verbose(verbose, "\tWriting the grayscale value...");
   // Write the grayscale value
   fprintf(file, "%u\n", grayScale);
+}
+
+size_t formatHeaderPGM(char *buffer, size_t size, size_t width,
+                       unsigned char grayScale, const char *comments) {
+  int n = snprintf(buffer, size, "P5\n%s%zu %zu\n%u\n",
+                   comments == NULL ? "" : comments, width, width, grayScale);
+  return n < 0 ? 0 : (size_t)n;
+}
+
+int writePGMStream(FILE *file, unsigned char *pixmap, size_t width,
+                   unsigned char grayScale, char *comments, int verbose) {
+  assert(file != NULL);
+  assert(pixmap != NULL);
+  assert(width > 0);
+
+  writeHeaderPGM(file, width, grayScale, comments, verbose);
 
   print_verbose(verbose, "\tWriting the pixmap data...");
   // Write the pixmap data
-  fwrite(pixmap, sizeof(unsigned char), width * width, file);
+  if (fwrite(pixmap, sizeof(unsigned char), width * width, file) !=
+      width * width)
+    return -1;
 
   print_verbose(verbose, "\x1b[1;32mWriting successful!\x1b[0m");
+  return 0;
+}
+
+int openMappedPGM(const char *filename, size_t width, unsigned char grayScale,
+                  char *comments, MappedPGM *pgm, int verbose) {
+  assert(filename != NULL);
+  assert(pgm != NULL);
+  assert(width > 0);
 
+  char message[100];
+  sprintf(message, "\x1b[1;32mMapping PGM file:\x1b[0m \x1b[1;35m%s\x1b[0m",
+          filename);
+  print_verbose(verbose, message);
+  FILE *file = fopen(filename, "w+b");
+  if (file == NULL) {
+    return -1;
+  }
+  writeHeaderPGM(file, width, grayScale, comments, verbose);
+  long header = fflush(file) == 0 ? ftell(file) : -1;
+
+  // the blocks of the file are reserved before the pixels are written in
+  // place: a sparse file could run out of space while being drawn, which
+  // would raise SIGBUS instead of an error
+  print_verbose(verbose, "\tMapping the pixmap data...");
+  void *base = MAP_FAILED;
+  size_t length = (size_t)header + width * width;
+  int space = header > 0 && (off_t)length > 0
+                  ? posix_fallocate(fileno(file), 0, (off_t)length)
+                  : -1;
+  if (space > 0)
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be allocated: %s\n",
+            filename, strerror(space));
+  if (space == 0)
+    base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fileno(file), 0);
+  // no partial image is left behind, unless the output is not a plain file
+  struct stat st;
+  int regular = fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode);
+  // the mapping stays valid once the file is closed
   fclose(file);
+  if (base == MAP_FAILED) {
+    if (regular)
+      remove(filename);
+    return -1;
+  }
+  pgm->base = base;
+  pgm->length = length;
+  pgm->pixmap = (unsigned char *)base + header;
+  pgm->width = width;
+  return 0;
+}
+
+void releaseMappedRows(MappedPGM *pgm, size_t firstRow, size_t lastRow) {
+  assert(pgm != NULL);
+  assert(pgm->base != NULL);
+  // only whole pages are released, the page holding the end of the rows may
+  // still be written by the next band
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t first = (size_t)(pgm->pixmap - (unsigned char *)pgm->base) +
+                 firstRow * pgm->width;
+  size_t last = first + (lastRow - firstRow) * pgm->width;
+  first -= first % page;
+  last -= last % page;
+  // the pages of a shared file mapping are written to the file, not lost
+  if (last > first)
+    madvise((unsigned char *)pgm->base + first, last - first, MADV_DONTNEED);
+}
 
+int closeMappedPGM(MappedPGM *pgm, int verbose) {
+  assert(pgm != NULL);
+  if (pgm->base == NULL)
+    return 0;
+  int status = munmap(pgm->base, pgm->length) == 0 ? 0 : -1;
+  pgm->base = NULL;
+  pgm->pixmap = NULL;
   print_verbose(verbose, "\x1b[1;32mSaving the file...\n\x1b[0m");
-  return 0;
-}
\ No newline at end of file
+  return status;
+}
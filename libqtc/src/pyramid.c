@@ -0,0 +1,239 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#include "qtc.h"
+#include "coder.h"
+#include "decoder.h"
+#include "file_naming.h"
+#include "parallel.h"
+#include "quadtree.h"
+#include "verbose.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// @brief Parameters of a pyramid and the blocks built by the threads
+typedef struct {
+  char **tiles;      // names of the leaf tiles, row by row
+  size_t gridWidth;  // number of leaf tiles per side
+  char *output;      // prefix of the names of the written tiles
+  double alpha;      // alpha value
+  double beta;       // beta value
+  int lossless;      // if 1, the tiles are not filtered
+  int indexLevel;    // level of the subtree index of the written tiles
+  int verbose;       // 1 if verbose mode is enabled, 0 otherwise
+  QuadTree **blocks; // trees of the blocks built by the threads
+  size_t blockSize;  // number of leaf tiles per side of a block, 0 while the
+                     // threads build them
+} Pyramid;
+
+/// @brief Decodes a .qtc tile with every node set.
+/// @param input name of the .qtc file
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return The QuadTree, NULL if the file could not be parsed.
+static QuadTree *loadTile(const char *input, int verbose) {
+  QuadTree *qt = NULL;
+  unsigned char grayScale;
+  // the merged tiles have no comments
+  if (QTC_decoder(input, &qt, &grayScale, NULL, verbose) == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be correctly "
+                    "parsed\n",
+            input);
+    return NULL;
+  }
+  return qt;
+}
+
+/// @brief Writes a merged tile. Its tree is filtered for the file only, the
+/// filter is undone afterwards so that the level above merges the tree
+/// before filtering.
+/// @param qt The merged QuadTree.
+/// @param filename name of the file to write
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param lossless if 1, the tree is written without filtering.
+/// @param indexLevel level of the subtree index, 0 for none
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 otherwise.
+static int writeTile(QuadTree *qt, const char *filename, double alpha,
+                     double beta, int lossless, int indexLevel, int verbose) {
+  if (lossless)
+    return QTC_encoder(qt, filename, indexLevel, NULL, verbose);
+  // the statistics come from the merged means
+  if (computeStatistics(qt, verbose) == -1)
+    return -1;
+  FilterLog log = {NULL, NULL, 0, 0};
+  if (filterQuadTreeLogged(qt, alpha, beta, &log, verbose) == -1) {
+    freeFilterLog(&log);
+    return -1;
+  }
+  int status = QTC_encoder(qt, filename, indexLevel, NULL, verbose);
+  undoFilter(qt, &log);
+  freeFilterLog(&log);
+  return status;
+}
+
+int mergeImages(char **inputs, char *output, double alpha, double beta,
+                int lossless, int indexLevel, int verbose, int flag_o) {
+  // the inputs are given row by row, the children clockwise
+  static const int order[4] = {0, 1, 3, 2};
+  QuadTree *children[4] = {NULL, NULL, NULL, NULL};
+  int q = 0;
+  for (; q < 4; q++)
+    if ((children[q] = loadTile(inputs[order[q]], verbose)) == NULL)
+      break;
+  QuadTree *qt = q == 4 ? mergeQuadTrees(children, verbose) : NULL;
+  for (q = 0; q < 4; q++)
+    if (children[q] != NULL)
+      freeQuadTree(children[q]);
+  if (qt == NULL)
+    return -1;
+
+  char filename_out[64];
+  name_output_file(flag_o, output, filename_out, ".qtc", verbose, 0);
+  int status = writeTile(qt, filename_out, alpha, beta, lossless, indexLevel,
+                         verbose);
+  freeQuadTree(qt);
+  return status;
+}
+
+/// @brief Builds the tree of a square block of leaf tiles, depth first, and
+/// writes the merged tiles of the block. At most four trees per level are
+/// held at once.
+/// @param p The pyramid.
+/// @param row The row of the top left leaf tile of the block.
+/// @param col The column of the top left leaf tile of the block.
+/// @param size The number of leaf tiles per side of the block.
+/// @return The unfiltered tree of the block, NULL on failure.
+static QuadTree *pyramidBlock(Pyramid *p, size_t row, size_t col,
+                              size_t size) {
+  // the blocks built by the threads are taken over by the top levels
+  if (size == p->blockSize) {
+    QuadTree **block =
+        &p->blocks[row / size * (p->gridWidth / size) + col / size];
+    QuadTree *qt = *block;
+    *block = NULL;
+    return qt;
+  }
+  if (size == 1)
+    return loadTile(p->tiles[row * p->gridWidth + col], p->verbose);
+
+  size_t half = size / 2;
+  // order: TL, TR, BR, BL
+  size_t rows[4] = {row, row, row + half, row + half};
+  size_t cols[4] = {col, col + half, col + half, col};
+  QuadTree *children[4] = {NULL, NULL, NULL, NULL};
+  int q = 0;
+  for (; q < 4; q++)
+    if ((children[q] = pyramidBlock(p, rows[q], cols[q], half)) == NULL)
+      break;
+  QuadTree *qt = q == 4 ? mergeQuadTrees(children, p->verbose) : NULL;
+  for (q = 0; q < 4; q++)
+    if (children[q] != NULL)
+      freeQuadTree(children[q]);
+  if (qt == NULL)
+    return NULL;
+
+  // level 0 is the top tile
+  unsigned int level = 0;
+  for (size_t s = size; s < p->gridWidth; s *= 2)
+    level++;
+  char name[256];
+  char filename_out[300];
+  snprintf(name, sizeof(name), "%s_%u_%zu_%zu", p->output, level, row / size,
+           col / size);
+  name_output_file(1, name, filename_out, ".qtc", p->verbose, 0);
+  if (writeTile(qt, filename_out, p->alpha, p->beta, p->lossless,
+                p->indexLevel, p->verbose) == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be written\n",
+            filename_out);
+    freeQuadTree(qt);
+    return NULL;
+  }
+  return qt;
+}
+
+/// @brief Blocks [first, last) built by a thread
+typedef struct {
+  Pyramid *p;   // the pyramid
+  size_t size;  // number of leaf tiles per side of a block
+  size_t first; // first block, row by row
+  size_t last;  // block after the last one
+} BlockJob;
+
+/// @brief Builds the blocks of a job.
+/// @param arg The job
+/// @return NULL
+static void *buildBlocks(void *arg) {
+  BlockJob *job = (BlockJob *)arg;
+  size_t blocksPerSide = job->p->gridWidth / job->size;
+  for (size_t i = job->first; i < job->last; i++)
+    job->p->blocks[i] =
+        pyramidBlock(job->p, i / blocksPerSide * job->size,
+                     i % blocksPerSide * job->size, job->size);
+  return NULL;
+}
+
+int buildPyramid(char **tiles, size_t gridWidth, char *output, double alpha,
+                 double beta, int lossless, int indexLevel, int verbose) {
+  if (gridWidth < 2 || (gridWidth & (gridWidth - 1)) != 0) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: the pyramid needs a power of "
+                    "two of at least 2 tiles per side\n");
+    return -1;
+  }
+  size_t numThreads = parallelThreads(SIZE_MAX);
+  // the grid is split in as many blocks as threads, each built depth first
+  // by a thread, then the levels above them are built by the current thread
+  size_t blocksPerSide = 1;
+  while (blocksPerSide * blocksPerSide < numThreads &&
+         blocksPerSide < gridWidth)
+    blocksPerSide *= 2;
+  size_t numBlocks = blocksPerSide * blocksPerSide;
+  if (numThreads > numBlocks)
+    numThreads = numBlocks;
+
+  QuadTree **blocks = (QuadTree **)calloc(numBlocks, sizeof(QuadTree *));
+  if (blocks == NULL)
+    return -1;
+  Pyramid p = {tiles, gridWidth, output, alpha, beta, lossless,
+               indexLevel, verbose, blocks, 0};
+  char message[150];
+  sprintf(message,
+          "\x1b[1;32mBuilding the pyramid of\x1b[0m \x1b[1;35m%zux%zu\x1b[0m "
+          "\x1b[1;32mtiles...\x1b[0m",
+          gridWidth, gridWidth);
+  print_verbose(verbose, message);
+
+  size_t size = gridWidth / blocksPerSide;
+  BlockJob jobs[numThreads];
+  for (size_t t = 0; t < numThreads; t++)
+    jobs[t] = (BlockJob){&p, size, t * numBlocks / numThreads,
+                         (t + 1) * numBlocks / numThreads};
+  runParallel(buildBlocks, jobs, sizeof(BlockJob), numThreads);
+
+  // the top levels take the blocks over
+  int status = -1;
+  size_t built = 0;
+  for (size_t i = 0; i < numBlocks; i++)
+    built += blocks[i] != NULL;
+  if (built == numBlocks) {
+    p.blockSize = size;
+    QuadTree *top = pyramidBlock(&p, 0, 0, gridWidth);
+    if (top != NULL) {
+      freeQuadTree(top);
+      status = 0;
+    }
+  }
+  for (size_t i = 0; i < numBlocks; i++)
+    if (blocks[i] != NULL)
+      freeQuadTree(blocks[i]);
+  free(blocks);
+  if (status == 0)
+    print_verbose(verbose,
+                  "\x1b[1;32mPyramid built successfully!\n\x1b[0m");
+  return status;
+}
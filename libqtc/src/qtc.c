@@ -4,72 +4,248 @@
   Modified:    14/12/2024
   =========================================== */
 
+// localtime_r is not part of C17
+#define _POSIX_C_SOURCE 200809L
+
 #include "qtc.h"
 #include "coder.h"
+#include "decode_cache.h"
 #include "decoder.h"
 #include "file_naming.h"
+#include "large_alloc.h"
 #include "pgm_io.h"
 #include "quadtree.h"
 #include "segmentation.h"
+#include "sparse_quadtree.h"
+#include "transform.h"
 #include "verbose.h"
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #define TRUE 1
 #define FALSE 0
 
+// bytes of a mapped output drawn before their memory is given back
+#define MAPPED_BAND_SIZE ((size_t)64 << 20)
+
+/// @brief Checks that an image can be stored in a QuadTree.
+/// @param width The width of the image.
+/// @param height The height of the image.
+/// @return 0 if the image is a square with a power of two width, -1 otherwise.
+static int checkShape(size_t width, size_t height) {
+  if (width != height || (width & (width - 1)) != 0) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: the image must be a square "
+                    "with a power of two width\n");
+    return -1;
+  }
+  return 0;
+}
+
+/// @brief Writes the segmentation of an image, as a grid image and/or as a
+/// list of blocks.
+/// @param blocks The blocks of the segmentation.
+/// @param count The number of blocks.
+/// @param width The width of the image.
+/// @param output name of output file
+/// @param flag_g combination of SEGMENTATION_GRID and SEGMENTATION_BLOCKS
+/// @param grayScale The grayscale of the image
+/// @param comments Comments to write in the grid image
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @param flag_o 1 if output file is specified, 0 otherwise.
+/// @return 0 if the writing was successful, -1 otherwise.
+static int writeSegmentation(Block *blocks, size_t count, size_t width,
+                             char *output, int flag_g, unsigned char grayScale,
+                             char *comments, int verbose, int flag_o) {
+  if (flag_g & SEGMENTATION_GRID) {
+    char filename_out_segm[64];
+    name_output_file(flag_o, output, filename_out_segm, ".pgm", verbose, TRUE);
+    unsigned char *pixmap_segm = NULL;
+    if (drawSegmentationBlocks(blocks, count, width, &pixmap_segm, verbose) ==
+        -1) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: pixmap could not be built\n");
+      return -1;
+    }
+    writePGM(filename_out_segm, pixmap_segm, width, grayScale, comments,
+             verbose);
+    largeFree(pixmap_segm);
+  }
+  if (flag_g & SEGMENTATION_BLOCKS) {
+    char filename_out_blocks[64];
+    name_output_file(flag_o, output, filename_out_blocks, ".txt", verbose,
+                     TRUE);
+    writeSegmentationBlocks(filename_out_blocks, blocks, count, width,
+                            verbose);
+  }
+  return 0;
+}
+
+/// @brief Buffers of a caller of the memory entry points, kept from one call
+/// to the next
+struct CodecBuffers {
+  QuadTree *qt;        // tree of the last encoding, filled again if the size
+                       // is the same
+  SparseQuadTree *sqt; // tree of the last decoding
+  unsigned char *data; // answer of the last call
+  size_t capacity;     // number of bytes data can hold
+};
+
+/// @brief Decodes the content of a .qtc file into a pixmap. When the decode
+/// cache is enabled, a content decoded before is lent by the cache, and a
+/// new pixmap is handed over to it.
+/// @param qtc The content of the file.
+/// @param qtcSize The size of the content.
+/// @param image The decoded image, to free with releaseDecodedImage.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if the decoding was successful, -1 otherwise.
+static int decodePixmap(const unsigned char *qtc, size_t qtcSize,
+                        DecodedImage *image, int verbose) {
+  *image = (DecodedImage){NULL, 0, 0, NULL, NULL};
+  uint64_t hash = 0;
+  int cached = qtcSize != 0 && decodeCacheEnabled();
+  if (cached) {
+    hash = hashContent(qtc, qtcSize);
+    if (acquireDecodeCache(hash, qtc, qtcSize, image) == 0) {
+      print_verbose(verbose, "\x1b[1;32mDecoded from cache\x1b[0m");
+      return 0;
+    }
+  }
+
+  SparseQuadTree *sqt = NULL;
+  int status = QTC_decoderSparseBuffer(qtc, qtcSize, &sqt, &image->grayScale,
+                                       &image->comments, verbose);
+  if (status == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: data could not be correctly parsed\n");
+    return -1;
+  }
+
+  image->width = (size_t)1 << sqt->numLevels;
+  status = buildPixMapSparse(sqt, &image->pixmap, verbose);
+  freeSparseQuadTree(sqt);
+  if (status == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: pixmap could not be built\n");
+    releaseDecodedImage(image);
+    return -1;
+  }
+  if (cached)
+    storeDecodeCache(hash, qtc, qtcSize, image);
+  return 0;
+}
+
+unsigned char *loadFile(const char *filename, size_t *size) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+    return NULL;
+  unsigned char *data = NULL;
+  long len;
+  if (fseek(file, 0, SEEK_END) == 0 && (len = ftell(file)) > 0 &&
+      fseek(file, 0, SEEK_SET) == 0 && (data = malloc(len)) != NULL &&
+      fread(data, 1, len, file) != (size_t)len) {
+    free(data);
+    data = NULL;
+  }
+  fclose(file);
+  *size = data == NULL ? 0 : (size_t)len;
+  return data;
+}
+
+/// @brief Decodes a .qtc file through the decode cache.
+/// @param input name of input file
+/// @param output name of output file
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @param flag_o 1 if output file is specified, 0 otherwise.
+/// @return 0 if the decoding was successful, -1 otherwise.
+static int decodeImageCached(const char *input, char *output, int verbose,
+                             int flag_o) {
+  size_t size;
+  unsigned char *data = loadFile(input, &size);
+  if (data == NULL) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: file could not be read\n");
+    return -1;
+  }
+  DecodedImage image;
+  int status = decodePixmap(data, size, &image, verbose);
+  free(data);
+  if (status == -1)
+    return -1;
+
+  char filename_out[64];
+  name_output_file(flag_o, output, filename_out, ".pgm", verbose, FALSE);
+  writePGM(filename_out, image.pixmap, image.width, image.grayScale,
+           image.comments, verbose);
+  releaseDecodedImage(&image);
+  return 0;
+}
+
 int decodeImage(const char *input, char *output, int flag_g, int verbose,
                 int flag_o) {
-  QuadTree *qt = NULL;
+  // the segmentation needs the tree, it is never cached
+  if (flag_g == 0 && decodeCacheEnabled())
+    return decodeImageCached(input, output, verbose, flag_o);
+
+  SparseQuadTree *sqt = NULL;
   char *comments = NULL;
   unsigned char grayScale;
-
-  // decode file in qt
-  if (QTC_decoder(input, &qt, &grayScale, &comments, verbose) == -1) {
+  // decode file in sqt, only the stored nodes are allocated
+  if (QTC_decoderSparse(input, &sqt, &grayScale, &comments, verbose) == -1) {
     fprintf(stderr,
             "\x1b[1;31mError\x1b[0m: file could not be correctly parsed\n");
     return -1;
   }
 
-  unsigned char *pixmap = NULL;
-  size_t width = pow(2, qt->numLevels);
+  size_t width = (size_t)1 << sqt->numLevels;
+  char filename_out[64];
+  name_output_file(flag_o, output, filename_out, ".pgm", verbose, FALSE);
 
-  // build pixmap
-  if (buildPixMap(qt, &pixmap, qt->numLevels, verbose) == -1) {
-    fprintf(stderr, "\x1b[1;31mError\x1b[0m: pixmap could not be built\n");
-    freeQuadTree(qt);
+  // the image is drawn in place in the output file, no pixmap is built
+  MappedPGM pgm;
+  if (openMappedPGM(filename_out, width, grayScale, comments, &pgm, verbose) ==
+      -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be mapped\n",
+            filename_out);
+    freeSparseQuadTree(sqt);
+    free(comments);
+    return -1;
+  }
+  print_verbose(verbose, "\x1b[1;32mDrawing the image...\x1b[0m");
+  // large images are drawn band by band, so the pages of the file resident
+  // in memory stay within a band
+  size_t bandRows = MAPPED_BAND_SIZE / width > 0 ? MAPPED_BAND_SIZE / width : 1;
+  for (size_t row = 0; row < width; row += bandRows) {
+    size_t last = row + bandRows < width ? row + bandRows : width;
+    drawSparseRowsParallel(sqt, pgm.pixmap, width, row, last);
+    releaseMappedRows(&pgm, row, last);
+  }
+  if (closeMappedPGM(&pgm, verbose) == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be written\n",
+            filename_out);
+    freeSparseQuadTree(sqt);
+    free(comments);
     return -1;
   }
-
-  char filename_out[64];
-  name_output_file(flag_o, output, filename_out, ".pgm", verbose, FALSE);
-  // write output
-  writePGM(filename_out, pixmap, width, grayScale, comments, verbose);
 
   // if segmentation, write segmentation
-  if (flag_g == 1) {
-    char filename_out_segm[64];
-    name_output_file(flag_o, output, filename_out_segm, ".pgm", verbose,
-                     flag_g);
-    make_contoured_white_squares(qt);
-    unsigned char *pixmap_segm = NULL;
-    if (buildPixMap(qt, &pixmap_segm, qt->numLevels, verbose) == -1) {
-      fprintf(stderr, "\x1b[1;31mError\x1b[0m: pixmap could not be built\n");
-      freeQuadTree(qt);
-      free(pixmap);
+  if (flag_g != 0) {
+    Block *blocks = NULL;
+    size_t count;
+    if (listSparseBlocks(sqt, &blocks, &count) == -1 ||
+        writeSegmentation(blocks, count, width, output, flag_g, grayScale,
+                          comments, verbose, flag_o) == -1) {
+      fprintf(stderr,
+              "\x1b[1;31mError\x1b[0m: segmentation could not be built\n");
+      free(blocks);
+      freeSparseQuadTree(sqt);
       free(comments);
       return -1;
     }
-    writePGM(filename_out_segm, pixmap_segm, width, grayScale, comments,
-             verbose);
-    free(pixmap_segm);
+    free(blocks);
   }
 
-  freeQuadTree(qt);
-  free(pixmap);
+  freeSparseQuadTree(sqt);
   free(comments);
   return 0;
 }
@@ -77,9 +253,11 @@ int decodeImage(const char *input, char *output, int flag_g, int verbose,
 // print the comments of the QuadTree into comments
 int sprintComments(QuadTree *qt, char *comments) {
   time_t t = time(NULL);
-  struct tm tm = *localtime(&t);
+  // localtime shares its result between threads
+  struct tm tm;
   char buffer[32];
-  if (strftime(buffer, sizeof(buffer), "%c", &tm) == 0) {
+  if (localtime_r(&t, &tm) == NULL ||
+      strftime(buffer, sizeof(buffer), "%c", &tm) == 0) {
     fprintf(stderr,
             "\x1b[1;31mError\x1b[0m: date could not be written to the file\n");
     return -1;
@@ -87,15 +265,74 @@ int sprintComments(QuadTree *qt, char *comments) {
 
   size_t totalSize = calculateSize(qt, 0);
   totalSize += __CHAR_BIT__ - (totalSize % __CHAR_BIT__);
-  size_t numPixels = 1 << (2 * qt->numLevels);
-  float compression_rate = (float)totalSize / (numPixels * __CHAR_BIT__) * 100;
+  size_t numPixels = (size_t)1 << (2 * qt->numLevels);
+  float compression_rate =
+      (double)totalSize / ((double)numPixels * __CHAR_BIT__) * 100;
   sprintf(comments, "# %s\n# compression rate %.2f%%\n", buffer,
           compression_rate);
   return 0;
 }
 
+/// @brief Fills the filtered QuadTree of an image, in a tree kept by the
+/// caller when it has the size of the image.
+/// @param qt The tree, replaced if it is NULL or of another size.
+/// @param pixmap The image.
+/// @param width The width of the image.
+/// @param height The height of the image.
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param lossless if 1, no filtering is done.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return 0 if successful, -1 if the tree could not be built.
+static int fillTree(QuadTree **qt, unsigned char *pixmap, size_t width,
+                    size_t height, double alpha, double beta, int lossless,
+                    int verbose) {
+  if (checkShape(width, height) == -1)
+    return -1;
+
+  // a tree of the same size is filled again, every node is overwritten
+  if (*qt != NULL && ((size_t)1 << (*qt)->numLevels) != width) {
+    freeQuadTree(*qt);
+    *qt = NULL;
+  }
+  if (*qt == NULL && (*qt = createQuadTree(width, verbose)) == NULL) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: QuadTree could not be created\n");
+    return -1;
+  }
+
+  // fill and filter qt, the filter is skipped in lossless mode
+  if (fillQuadTree(*qt, pixmap, width, lossless, verbose) == -1)
+    return -1;
+  if (!lossless)
+    filterQuadTree(*qt, alpha, beta, verbose);
+  return 0;
+}
+
+/// @brief Builds the filtered QuadTree of an image.
+/// @param pixmap The image.
+/// @param width The width of the image.
+/// @param height The height of the image.
+/// @param alpha alpha value
+/// @param beta beta value
+/// @param lossless if 1, no filtering is done.
+/// @param verbose 1 if verbose mode is enabled, 0 otherwise.
+/// @return The QuadTree, NULL if it could not be built.
+static QuadTree *buildQuadTree(unsigned char *pixmap, size_t width,
+                               size_t height, double alpha, double beta,
+                               int lossless, int verbose) {
+  QuadTree *qt = NULL;
+  if (fillTree(&qt, pixmap, width, height, alpha, beta, lossless, verbose) ==
+      -1) {
+    if (qt != NULL)
+      freeQuadTree(qt);
+    return NULL;
+  }
+  return qt;
+}
+
 int encodeImage(const char *input, char *output, double alpha, double beta,
-                int flag_g, int verbose, int flag_o) {
+                int lossless, int indexLevel, int flag_g, int verbose,
+                int flag_o) {
   unsigned char *pixmap;
   size_t width, height;
   unsigned char grayScale;
@@ -109,43 +346,524 @@ int encodeImage(const char *input, char *output, double alpha, double beta,
     return -1;
   }
 
-  // create QuadTree
-  QuadTree *qt = createQuadTree(width, verbose);
+  QuadTree *qt =
+      buildQuadTree(pixmap, width, height, alpha, beta, lossless, verbose);
   if (qt == NULL) {
-    fprintf(stderr, "\x1b[1;31mError\x1b[0m: QuadTree could not be created\n");
-    free(pixmap);
+    largeFree(pixmap);
     return -1;
   }
 
-  // fill and filter qt
-  fillQuadTree(qt, pixmap, width, verbose);
-  filterQuadTree(qt, alpha, beta, verbose);
-
   // encode qt in filename_out
-  QTC_encoder(qt, filename_out, verbose);
+  QTC_encoder(qt, filename_out, indexLevel, NULL, verbose);
 
   // if segmentation, write segmentation
-  if (flag_g == 1) {
-    char filename_out_segm[64];
-    name_output_file(flag_o, output, filename_out_segm, ".pgm", verbose,
-                     flag_g);
-    make_contoured_white_squares(qt);
-    unsigned char *pixmap_segm = NULL;
-    if (buildPixMap(qt, &pixmap_segm, qt->numLevels, verbose) == -1) {
-      fprintf(stderr, "\x1b[1;31mError\x1b[0m: pixmap could not be built\n");
+  if (flag_g != 0) {
+    char comments[256];
+    sprintComments(qt, comments);
+    Block *blocks = NULL;
+    size_t count;
+    if (listSegmentationBlocks(qt, &blocks, &count) == -1 ||
+        writeSegmentation(blocks, count, width, output, flag_g, grayScale,
+                          comments, verbose, flag_o) == -1) {
+      fprintf(stderr,
+              "\x1b[1;31mError\x1b[0m: segmentation could not be built\n");
+      free(blocks);
       freeQuadTree(qt);
-      free(pixmap);
+      largeFree(pixmap);
       return -1;
     }
-    char comments[256];
-    sprintComments(qt, comments);
-    writePGM(filename_out_segm, pixmap_segm, width, grayScale, comments,
-             verbose);
-    free(pixmap_segm);
+    free(blocks);
   }
 
   // free
   freeQuadTree(qt);
-  free(pixmap);
+  largeFree(pixmap);
+  return 0;
+}
+
+int encodeMemory(const unsigned char *pgm, size_t pgmSize, double alpha,
+                 double beta, int lossless, int indexLevel, unsigned char **qtc,
+                 size_t *qtcSize, int verbose) {
+  unsigned char *pixmap;
+  size_t width, height;
+  unsigned char grayScale;
+  if (readPGMMemory(pgm, pgmSize, &pixmap, &width, &height, &grayScale,
+                    verbose) == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: data could not be correctly parsed\n");
+    return -1;
+  }
+  QuadTree *qt =
+      buildQuadTree(pixmap, width, height, alpha, beta, lossless, verbose);
+  largeFree(pixmap);
+  if (qt == NULL)
+    return -1;
+
+  // the file is built in a buffer given to the caller
+  unsigned char *data = NULL;
+  size_t capacity = 0;
+  int status = QTC_encoderBuffer(qt, &data, &capacity, qtcSize, indexLevel,
+                                 NULL, verbose);
+  freeQuadTree(qt);
+  if (status == -1) {
+    free(data);
+    return -1;
+  }
+  *qtc = data;
+  return 0;
+}
+
+int decodeMemory(const unsigned char *qtc, size_t qtcSize, unsigned char **pgm,
+                 size_t *pgmSize, int verbose) {
+  // the buffers only serve this decode, the answer is given to the caller
+  CodecBuffers buffers = {NULL, NULL, NULL, 0};
+  const unsigned char *data;
+  int status =
+      decodeMemoryBuffered(&buffers, qtc, qtcSize, &data, pgmSize, verbose);
+  freeDecodeTree(buffers.sqt);
+  if (status == -1) {
+    free(buffers.data);
+    return -1;
+  }
+  *pgm = buffers.data;
+  return 0;
+}
+
+CodecBuffers *createCodecBuffers(void) {
+  return calloc(1, sizeof(CodecBuffers));
+}
+
+void freeCodecBuffers(CodecBuffers *buffers) {
+  if (buffers == NULL)
+    return;
+  if (buffers->qt != NULL)
+    freeQuadTree(buffers->qt);
+  freeDecodeTree(buffers->sqt);
+  free(buffers->data);
+  free(buffers);
+}
+
+int encodeMemoryBuffered(CodecBuffers *buffers, unsigned char *pgm,
+                         size_t pgmSize, double alpha, double beta,
+                         int lossless, int indexLevel,
+                         const unsigned char **qtc, size_t *qtcSize,
+                         int verbose) {
+  size_t width, height;
+  unsigned char grayScale;
+  // the pixmap is built over the PGM file, the tree and the answer are kept
+  // for the next call
+  if (readPGMInPlace(pgm, pgmSize, &width, &height, &grayScale, verbose) ==
+      -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: data could not be correctly parsed\n");
+    return -1;
+  }
+  if (fillTree(&buffers->qt, pgm, width, height, alpha, beta, lossless,
+               verbose) == -1 ||
+      QTC_encoderBuffer(buffers->qt, &buffers->data, &buffers->capacity,
+                        qtcSize, indexLevel, NULL, verbose) == -1)
+    return -1;
+  *qtc = buffers->data;
   return 0;
 }
+
+int decodeMemoryBuffered(CodecBuffers *buffers, const unsigned char *qtc,
+                         size_t qtcSize, const unsigned char **pgm,
+                         size_t *pgmSize, int verbose) {
+  DecodedImage image = {NULL, 0, 0, NULL, NULL};
+  // an image of the cache is copied in the answer, otherwise the tree is
+  // read in the one kept and drawn straight in the answer
+  int cached = qtcSize != 0 && decodeCacheEnabled();
+  if (cached) {
+    if (decodePixmap(qtc, qtcSize, &image, verbose) == -1)
+      return -1;
+  } else {
+    if (QTC_decoderSparseBuffer(qtc, qtcSize, &buffers->sqt, &image.grayScale,
+                                &image.comments, verbose) == -1) {
+      fprintf(stderr,
+              "\x1b[1;31mError\x1b[0m: data could not be correctly parsed\n");
+      return -1;
+    }
+    image.width = (size_t)1 << buffers->sqt->numLevels;
+  }
+
+  size_t header =
+      formatHeaderPGM(NULL, 0, image.width, image.grayScale, image.comments);
+  size_t size = header + image.width * image.width;
+  int status = 0;
+  // the buffer only grows, with a byte for the null of the header
+  if (size + 1 > buffers->capacity) {
+    unsigned char *grown = realloc(buffers->data, size + 1);
+    if (grown == NULL) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: memory allocation failed\n");
+      status = -1;
+    } else {
+      buffers->data = grown;
+      buffers->capacity = size + 1;
+    }
+  }
+  if (status == 0) {
+    formatHeaderPGM((char *)buffers->data, header + 1, image.width,
+                    image.grayScale, image.comments);
+    if (cached)
+      memcpy(buffers->data + header, image.pixmap, image.width * image.width);
+    else
+      drawSparseQuadTreeParallel(buffers->sqt, buffers->data + header,
+                                 image.width);
+    *pgm = buffers->data;
+    *pgmSize = size;
+  }
+  if (cached)
+    releaseDecodedImage(&image);
+  else
+    free(image.comments);
+  return status;
+}
+
+int requantizeImage(const char *input, char *output, double alpha,
+                    double beta, int indexLevel, int verbose, int flag_o) {
+  QuadTree *qt = NULL;
+  char *comments = NULL;
+  unsigned char grayScale;
+
+  // the tree is decoded with every node set, no pixmap is built
+  if (QTC_decoder(input, &qt, &grayScale, &comments, verbose) == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: file could not be correctly parsed\n");
+    return -1;
+  }
+
+  // the statistics come from the decoded means, then the tree is filtered
+  // again and written as is
+  if (computeStatistics(qt, verbose) == -1) {
+    freeQuadTree(qt);
+    free(comments);
+    return -1;
+  }
+  filterQuadTree(qt, alpha, beta, verbose);
+
+  // the metadata of the input are kept
+  char filename_out[64];
+  name_output_file(flag_o, output, filename_out, ".qtc", verbose, FALSE);
+  int status = QTC_encoder(qt, filename_out, indexLevel, comments, verbose);
+  freeQuadTree(qt);
+  free(comments);
+  return status;
+}
+
+int transformImage(const char *input, char *output, int op, int indexLevel,
+                   int verbose, int flag_o) {
+  QuadTree *qt = NULL;
+  char *comments = NULL;
+  unsigned char grayScale;
+
+  // the tree is decoded with every node set, no pixmap is built
+  if (QTC_decoder(input, &qt, &grayScale, &comments, verbose) == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: file could not be correctly parsed\n");
+    return -1;
+  }
+
+  QuadTree *result = transformQuadTree(qt, op, verbose);
+  freeQuadTree(qt);
+  if (result == NULL) {
+    free(comments);
+    return -1;
+  }
+
+  // the metadata of the input are kept
+  char filename_out[64];
+  name_output_file(flag_o, output, filename_out, ".qtc", verbose, FALSE);
+  int status =
+      QTC_encoder(result, filename_out, indexLevel, comments, verbose);
+  freeQuadTree(result);
+  free(comments);
+  return status;
+}
+
+SparseQuadTree *createDecodeTree(void) {
+  return createSparseQuadTree(0);
+}
+
+void freeDecodeTree(SparseQuadTree *sqt) {
+  if (sqt != NULL)
+    freeSparseQuadTree(sqt);
+}
+
+SparseQuadTree *loadDecodeTree(const char *input, int verbose) {
+  SparseQuadTree *sqt = NULL;
+  unsigned char grayScale;
+  if (QTC_decoderSparse(input, &sqt, &grayScale, NULL, verbose) == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: file could not be correctly parsed\n");
+    return NULL;
+  }
+  return sqt;
+}
+
+int saveDecodeTree(SparseQuadTree *sqt, const char *output, int verbose) {
+  if (QTC_encoderSparse(sqt, output, NULL, verbose) == -1) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be written\n",
+            output);
+    return -1;
+  }
+  return 0;
+}
+
+int regionMean(SparseQuadTree *sqt, size_t x, size_t y, size_t w, size_t h,
+               double *mean) {
+  size_t width = (size_t)1 << sqt->numLevels;
+  if (w == 0 || h == 0 || x > width || w > width - x || y > width ||
+      h > width - y) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: the region is not inside the "
+                    "%zux%zu image\n",
+            width, width);
+    return -1;
+  }
+  *mean = (double)sparseRegionSum(sqt, x, y, w, h) / ((double)w * h);
+  return 0;
+}
+
+void imageHistogram(SparseQuadTree *sqt, size_t histogram[256]) {
+  sparseHistogram(sqt, histogram);
+}
+
+void imageMinMax(SparseQuadTree *sqt, unsigned char *min, unsigned char *max) {
+  sparseMinMax(sqt, min, max);
+}
+
+int decodeIntoTree(const unsigned char *qtc, size_t qtcSize,
+                   SparseQuadTree *sqt, unsigned char *canvas,
+                   size_t canvasWidth, size_t canvasHeight, size_t stride,
+                   size_t x0, size_t y0, int verbose) {
+  unsigned char h, grayScale;
+  if (sqt == NULL || QTC_readHeight(qtc, qtcSize, &h) == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: data could not be correctly parsed\n");
+    return -1;
+  }
+
+  // the tile must lie inside the canvas, whose rows must not overlap
+  size_t width = (size_t)1 << h;
+  if (stride < canvasWidth || x0 > canvasWidth || width > canvasWidth - x0 ||
+      y0 > canvasHeight || width > canvasHeight - y0) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: the %zux%zu image does not fit "
+                    "in the canvas at (%zu, %zu)\n",
+            width, width, x0, y0);
+    return -1;
+  }
+
+  // the bits are read from the data and the canvas has no comments, so
+  // nothing is allocated once the tree has held a tile as large
+  if (QTC_decoderSparseBuffer(qtc, qtcSize, &sqt, &grayScale, NULL,
+                              verbose) == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: data could not be correctly parsed\n");
+    return -1;
+  }
+  print_verbose(verbose, "\x1b[1;32mDrawing in the canvas...\x1b[0m");
+  drawSparseQuadTree(sqt, canvas + y0 * stride + x0, stride);
+  return 0;
+}
+
+int decodeInto(const unsigned char *qtc, size_t qtcSize, unsigned char *canvas,
+               size_t canvasWidth, size_t canvasHeight, size_t stride,
+               size_t x0, size_t y0, int verbose) {
+  SparseQuadTree *sqt = createDecodeTree();
+  if (sqt == NULL)
+    return -1;
+  int status = decodeIntoTree(qtc, qtcSize, sqt, canvas, canvasWidth,
+                              canvasHeight, stride, x0, y0, verbose);
+  freeDecodeTree(sqt);
+  return status;
+}
+
+/// @brief Computes the PSNR between two pixmaps.
+/// @param a The first pixmap.
+/// @param b The second pixmap.
+/// @param numPixels The number of pixels of the pixmaps.
+/// @return The PSNR in dB, INFINITY if the pixmaps are identical.
+static double computePSNR(unsigned char *a, unsigned char *b,
+                          size_t numPixels) {
+  unsigned long long sum = 0;
+  for (size_t i = 0; i < numPixels; i++) {
+    int d = a[i] - b[i];
+    sum += d * d;
+  }
+  if (sum == 0)
+    return INFINITY;
+  double mse = (double)sum / numPixels;
+  return 10. * log10(255. * 255. / mse);
+}
+
+int sweepImage(const char *input, char *output, const double *alpha,
+               const double *beta, size_t count, SweepResult *results,
+               int *best, double minPSNR, int indexLevel, int verbose,
+               int flag_o) {
+  unsigned char *pixmap;
+  size_t width, height;
+  unsigned char grayScale;
+  *best = -1;
+
+  // read pgm input
+  if (readPGM(input, &pixmap, &width, &height, &grayScale, verbose) == -1) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: file could not be correctly parsed\n");
+    return -1;
+  }
+  if (checkShape(width, height) == -1) {
+    largeFree(pixmap);
+    return -1;
+  }
+
+  // create and fill the QuadTree once for all the parameters
+  QuadTree *qt = createQuadTree(width, verbose);
+  if (qt == NULL) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: QuadTree could not be created\n");
+    largeFree(pixmap);
+    return -1;
+  }
+  if (fillQuadTree(qt, pixmap, width, FALSE, verbose) == -1) {
+    freeQuadTree(qt);
+    largeFree(pixmap);
+    return -1;
+  }
+
+  FilterLog log = {0};
+  char message[100];
+  for (size_t i = 0; i < count; i++) {
+    sprintf(message,
+            "\x1b[1;32mSweep\x1b[0m alpha \x1b[1;35m%.2f\x1b[0m beta "
+            "\x1b[1;35m%.2f\x1b[0m",
+            alpha[i], beta[i]);
+    print_verbose(verbose, message);
+    // filter, measure, then revert the filter for the next parameters
+    unsigned char *decoded = NULL;
+    if (filterQuadTreeLogged(qt, alpha[i], beta[i], &log, FALSE) == -1 ||
+        buildPixMap(qt, &decoded, qt->numLevels, FALSE) == -1) {
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: sweep could not be done\n");
+      freeFilterLog(&log);
+      freeQuadTree(qt);
+      largeFree(pixmap);
+      return -1;
+    }
+    size_t totalSize = calculateSize(qt, 0);
+    results[i].alpha = alpha[i];
+    results[i].beta = beta[i];
+    results[i].size = (totalSize + __CHAR_BIT__ - 1) / __CHAR_BIT__;
+    results[i].psnr = computePSNR(pixmap, decoded, width * width);
+    largeFree(decoded);
+    undoFilter(qt, &log);
+
+    // the best result is the smallest one reaching the minimum PSNR
+    if (results[i].psnr >= minPSNR &&
+        (*best == -1 || results[i].size < results[*best].size ||
+         (results[i].size == results[*best].size &&
+          results[i].psnr > results[*best].psnr)))
+      *best = i;
+  }
+  freeFilterLog(&log);
+
+  // write only the best result, if one was asked for
+  if (minPSNR >= 0 && *best != -1) {
+    char filename_out[64];
+    name_output_file(flag_o, output, filename_out, ".qtc", verbose, FALSE);
+    filterQuadTree(qt, alpha[*best], beta[*best], verbose);
+    QTC_encoder(qt, filename_out, indexLevel, NULL, verbose);
+  }
+
+  freeQuadTree(qt);
+  largeFree(pixmap);
+  return 0;
+}
+
+int encodeSequence(char **inputs, size_t count, char *output, double alpha,
+                   double beta, int lossless, int verbose) {
+  QuadTree *ref = NULL;
+  char name[256];
+  char filename_out[300];
+  int status = 0;
+  for (size_t k = 0; k < count && status == 0; k++) {
+    unsigned char *pixmap;
+    size_t width, height;
+    unsigned char grayScale;
+    if (readPGM(inputs[k], &pixmap, &width, &height, &grayScale, verbose) ==
+        -1) {
+      fprintf(stderr,
+              "\x1b[1;31mError\x1b[0m: %s could not be correctly parsed\n",
+              inputs[k]);
+      status = -1;
+      break;
+    }
+    QuadTree *qt =
+        buildQuadTree(pixmap, width, height, alpha, beta, lossless, verbose);
+    largeFree(pixmap);
+    if (qt == NULL) {
+      status = -1;
+      break;
+    }
+
+    snprintf(name, sizeof(name), "%s_%zu", output, k);
+    name_output_file(1, name, filename_out, ".qtc", verbose, FALSE);
+    if (ref == NULL) {
+      // the first frame is an ordinary file, then the reference of the next
+      // one, as the decoder holds it
+      status = QTC_encoder(qt, filename_out, 0, NULL, verbose);
+      reconstructQuadTree(qt);
+      ref = qt;
+    } else {
+      status = QTC_encoderInter(qt, ref, filename_out, verbose);
+      freeQuadTree(qt);
+    }
+    if (status == -1)
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be written\n",
+              filename_out);
+  }
+  if (ref != NULL)
+    freeQuadTree(ref);
+  return status;
+}
+
+int decodeSequence(char **inputs, size_t count, char *output, int verbose) {
+  QuadTree *ref = NULL;
+  unsigned char *pixmap = NULL;
+  unsigned char grayScale = 255;
+  uint64_t id = 0;
+  char name[256];
+  char filename_out[300];
+  int status = 0;
+  for (size_t k = 0; k < count && status == 0; k++) {
+    // the first frame is decoded whole, the next ones only draw their
+    // changes over it, once checked they were coded over it
+    if (k == 0) {
+      status = QTC_decoder(inputs[0], &ref, &grayScale, NULL, verbose) == -1 ||
+                       buildPixMap(ref, &pixmap, ref->numLevels, verbose) ==
+                           -1
+                   ? -1
+                   : 0;
+      if (status == 0)
+        id = hashQuadTree(ref);
+    } else {
+      status = QTC_decoderInter(inputs[k], ref, pixmap, &id, verbose);
+    }
+    if (status == -1) {
+      fprintf(stderr,
+              "\x1b[1;31mError\x1b[0m: %s could not be correctly parsed\n",
+              inputs[k]);
+      break;
+    }
+
+    snprintf(name, sizeof(name), "%s_%zu", output, k);
+    name_output_file(1, name, filename_out, ".pgm", verbose, FALSE);
+    status = writePGM(filename_out, pixmap, (size_t)1 << ref->numLevels,
+                      grayScale, NULL, verbose);
+    if (status == -1)
+      fprintf(stderr, "\x1b[1;31mError\x1b[0m: %s could not be written\n",
+              filename_out);
+  }
+  if (pixmap != NULL)
+    largeFree(pixmap);
+  if (ref != NULL)
+    freeQuadTree(ref);
+  return status;
+}
@@ -5,13 +5,20 @@
   =========================================== */
 
 #include "quadtree.h"
+#include "large_alloc.h"
 
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
+static int varianceMode = VARIANCE_EXACT;
+
+void setVarianceMode(int mode) { varianceMode = mode; }
+
 static unsigned char log_2(size_t n) {
   unsigned char i = 0;
   while (n >>= 1)
@@ -29,14 +36,15 @@ static unsigned int sumMeans(Node *root, size_t childIndex) {
 }
 
 /// @brief Calculates the variance of a node.
-/// @param root The root of the QuadTree.
+/// @param qt The QuadTree.
 /// @param index The index of the node.
 /// @return The variance of the node.
-static double calculateVariance(Node *root, size_t index) {
+static double calculateVariance(QuadTree *qt, size_t index) {
+  Node *root = qt->root;
   double µ = 0.;
   size_t childIndex = 4 * index + 1;
   for (size_t i = 0; i < 4; i++) {
-    µ += root[childIndex + i].v * root[childIndex + i].v +
+    µ += qt->v[childIndex + i] * qt->v[childIndex + i] +
          (root[index].m - root[childIndex + i].m) *
              (root[index].m - root[childIndex + i].m);
   }
@@ -56,16 +64,91 @@ static unsigned char isUniform(Node *node, size_t childIndex) {
           node[childIndex + 2].u && node[childIndex + 3].u);
 }
 
-static void fillQuadTree_aux(QuadTree *qt, unsigned char *pixmap, size_t x,
-                             size_t y, unsigned char level, size_t index,
-                             size_t width) {
+// blocks tested with the summed-area table: smaller ones are cheaper to
+// build than to test, the (256 - 1)^2 inner pixels of the largest ones keep
+// the 16-bit sums exact
+#define MIN_TESTED_BLOCK 4
+#define MAX_TESTED_BLOCK 256
+
+/// @brief Builds the summed-area table of the intensity changes of a pixmap:
+/// a pixel counts as a change when it differs from its left or upper
+/// neighbour. The entry (x, y), at y * (width + 1) + x, holds the number of
+/// changes of the pixels [0, x) x [0, y), modulo 2^16.
+/// @param pixmap The pixmap.
+/// @param width The width of the pixmap.
+/// @return The table, to free with largeFree, NULL if it could not be
+/// allocated.
+static uint16_t *buildChangeSums(unsigned char *pixmap, size_t width) {
+  size_t stride = width + 1;
+  if (stride > SIZE_MAX / stride / sizeof(uint16_t))
+    return NULL;
+  uint16_t *sat = (uint16_t *)largeAlloc(stride * stride * sizeof(uint16_t));
+  if (sat == NULL)
+    return NULL;
+  memset(sat, 0, stride * sizeof(uint16_t));
+  for (size_t y = 0; y < width; y++) {
+    const unsigned char *row = &pixmap[y * width];
+    const unsigned char *up = y == 0 ? row : row - width;
+    const uint16_t *above = &sat[y * stride];
+    uint16_t *cur = &sat[(y + 1) * stride];
+    // the first pixel has no left neighbour
+    uint16_t count = row[0] != up[0];
+    cur[0] = 0;
+    cur[1] = above[1] + count;
+    for (size_t x = 1; x < width; x++) {
+      count += (row[x] != row[x - 1]) | (row[x] != up[x]);
+      cur[x + 1] = above[x + 1] + count;
+    }
+  }
+  return sat;
+}
+
+/// @brief Checks with the summed-area table if a block has a single
+/// intensity. Its inner pixels (all but the first row and column) must have
+/// no change, they then tie every pixel to its neighbours except the first
+/// one, which is compared to the second.
+/// @param sat The summed-area table, NULL if there is none.
+/// @param pixmap The pixmap.
+/// @param x The column of the block.
+/// @param y The row of the block.
+/// @param size The width of the block.
+/// @param width The width of the pixmap.
+/// @return 1 if the block has a single intensity, 0 if not or if its size is
+/// not tested.
+static int isConstantBlock(const uint16_t *sat, unsigned char *pixmap,
+                           size_t x, size_t y, size_t size, size_t width) {
+  if (sat == NULL || size < MIN_TESTED_BLOCK || size > MAX_TESTED_BLOCK)
+    return 0;
+  if (pixmap[y * width + x] != pixmap[y * width + x + 1])
+    return 0;
+  size_t stride = width + 1;
+  size_t top = (y + 1) * stride, bottom = (y + size) * stride;
+  uint16_t changes = sat[bottom + x + size] - sat[bottom + x + 1] -
+                     sat[top + x + size] + sat[top + x + 1];
+  return changes == 0;
+}
+
+void fillUniform(QuadTree *qt, size_t index, unsigned char level,
+                 unsigned char m) {
+  Node node = {m, 1, 0};
+  qt->root[index] = node;
+  for (unsigned char depth = 1; level + depth <= qt->numLevels; depth++) {
+    Node *first = &qt->root[firstDescendant(index, depth)];
+    size_t count = (size_t)1 << (2 * depth);
+    for (size_t i = 0; i < count; i++)
+      first[i] = node;
+  }
+}
+
+static void fillQuadTree_aux(QuadTree *qt, unsigned char *pixmap,
+                             const uint16_t *sat, size_t x, size_t y,
+                             unsigned char level, size_t index, size_t width) {
 
   if (level == qt->numLevels) { // last level
     // fill the leaf node with the corrsponding pixel value
     qt->root[index].m = pixmap[y * width + x];
     qt->root[index].u = 1;
     qt->root[index].e = 0;
-    qt->root[index].v = 0.;
   } else {
     size_t childIndex = 4 * index + 1;
 
@@ -74,17 +157,24 @@ static void fillQuadTree_aux(QuadTree *qt, unsigned char *pixmap, size_t x,
     // quandrant at a certain level
     // in the current level the size of a quadrant is shiftxshift
     size_t depth_from_bottom = qt->numLevels - level - 1;
-    size_t shift = 1 << depth_from_bottom;
+    size_t shift = (size_t)1 << depth_from_bottom;
+
+    // a block with a single intensity is uniform down to its pixels, its
+    // subtree is not built recursively
+    if (isConstantBlock(sat, pixmap, x, y, 2 * shift, width)) {
+      fillUniform(qt, index, level, pixmap[y * width + x]);
+      return;
+    }
 
     // recursively fill the children of the current node
-    fillQuadTree_aux(qt, pixmap, x, y, level + 1, childIndex,
+    fillQuadTree_aux(qt, pixmap, sat, x, y, level + 1, childIndex,
                      width); // top left
-    fillQuadTree_aux(qt, pixmap, x + shift, y, level + 1, childIndex + 1,
+    fillQuadTree_aux(qt, pixmap, sat, x + shift, y, level + 1, childIndex + 1,
                      width); // top right
-    fillQuadTree_aux(qt, pixmap, x + shift, y + shift, level + 1,
+    fillQuadTree_aux(qt, pixmap, sat, x + shift, y + shift, level + 1,
                      childIndex + 2,
                      width); // bottom right
-    fillQuadTree_aux(qt, pixmap, x, y + shift, level + 1, childIndex + 3,
+    fillQuadTree_aux(qt, pixmap, sat, x, y + shift, level + 1, childIndex + 3,
                      width); // bottom left
 
     unsigned int sum = sumMeans(qt->root, childIndex);
@@ -94,24 +184,117 @@ static void fillQuadTree_aux(QuadTree *qt, unsigned char *pixmap, size_t x,
     qt->root[index].e = sum % 4;
     // if the error bit != 0  ==> the block is not uniform
     // we need to stock the uniformity bit of the block only if the error bit is
-    // 0
-    if (qt->root[index].e == 0)
-      qt->root[index].u = isUniform(qt->root, childIndex);
+    // 0. It is still cleared otherwise: the array may hold a previous tree,
+    // and isUniform reads the bits of the children
+    qt->root[index].u =
+        qt->root[index].e == 0 ? isUniform(qt->root, childIndex) : 0;
+  }
+}
+
+/// @brief Computes the variances of the legacy filter, from the level above
+/// the leaves up to the root since a variance needs the variances of the
+/// children.
+/// @param qt The QuadTree.
+/// @return 0 if successful, -1 if the variances could not be allocated.
+static int computeVariances(QuadTree *qt) {
+  // the variances of the leaves are 0
+  // largeCalloc checks the size of the array for overflow
+  qt->v = (double *)largeCalloc(totalNodes(qt->numLevels), sizeof(double));
+  if (qt->v == NULL)
+    return -1;
+  // a uniform node has a single intensity below it, its variance stays 0
+  for (int level = qt->numLevels - 1; level >= 0; level--)
+    for (size_t index = LEVEL_START(level); index < LEVEL_START(level + 1);
+         index++)
+      if (qt->root[index].e != 0 || qt->root[index].u != 1)
+        qt->v[index] = calculateVariance(qt, index);
+  return 0;
+}
+
+/// @brief Computes the sums of the pixels and of their squares of the nodes
+/// above the last two levels, level by level from the bottom. Each node adds
+/// up its four consecutive children, the loops have no dependency between
+/// nodes. The sums are exact up to 2^48 pixels.
+/// @param qt The QuadTree.
+/// @return 0 if successful, -1 if the sums could not be allocated.
+static int computeMoments(QuadTree *qt) {
+  size_t numNodes = qt->numLevels < 2 ? 0 : totalNodes(qt->numLevels - 2);
+  // the sums of a tree filled again are overwritten in place
+  if (qt->sum == NULL)
+    qt->sum = (uint64_t *)largeAlloc((numNodes + 1) * sizeof(uint64_t));
+  if (qt->sumSq == NULL)
+    qt->sumSq = (uint64_t *)largeAlloc((numNodes + 1) * sizeof(uint64_t));
+  if (qt->sum == NULL || qt->sumSq == NULL)
+    return -1;
+  if (qt->numLevels < 2)
+    return 0;
+
+  uint64_t *sum = qt->sum, *sumSq = qt->sumSq;
+  for (int level = qt->numLevels - 2; level >= 0; level--)
+    for (size_t index = LEVEL_START(level); index < LEVEL_START(level + 1);
+         index++) {
+      size_t child = 4 * index + 1;
+      uint64_t s[4], sq[4];
+      for (int i = 0; i < 4; i++)
+        nodeMoments(qt, child + i, &s[i], &sq[i]);
+      sum[index] = s[0] + s[1] + s[2] + s[3];
+      sumSq[index] = sq[0] + sq[1] + sq[2] + sq[3];
+    }
+  return 0;
+}
 
-    // calculate the variance of the node
-    qt->root[index].v = calculateVariance(qt->root, index);
+/// @brief Frees the statistics of the filter.
+/// @param qt The QuadTree.
+static void freeStatistics(QuadTree *qt) {
+  largeFree(qt->sum);
+  largeFree(qt->sumSq);
+  largeFree(qt->v);
+  qt->sum = qt->sumSq = NULL;
+  qt->v = NULL;
+}
+
+int computeStatistics(QuadTree *qt, int verbose) {
+  assert(qt != NULL);
+  print_verbose(verbose, varianceMode == VARIANCE_EXACT
+                             ? "\tComputing the moments of the nodes"
+                             : "\tComputing the legacy variances");
+  // the legacy variances start from 0, the moments are all overwritten
+  if (varianceMode != VARIANCE_EXACT || qt->v != NULL)
+    freeStatistics(qt);
+  int status = varianceMode == VARIANCE_EXACT ? computeMoments(qt)
+                                              : computeVariances(qt);
+  if (status == -1) {
+    freeStatistics(qt);
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: memory allocation failed\n");
   }
+  return status;
 }
 
-void fillQuadTree(QuadTree *qt, unsigned char *pixmap, size_t width,
-                  int verbose) {
+int fillQuadTree(QuadTree *qt, unsigned char *pixmap, size_t width,
+                 int lossless, int verbose) {
   assert(qt != NULL);
   assert(pixmap != NULL);
   assert(width > 0);
 
   print_verbose(verbose, "\x1b[1;32mFilling the QuadTree...\x1b[0m");
-  fillQuadTree_aux(qt, pixmap, 0, 0, 0, 0, width);
+  // without the table every block is built down to its pixels
+  uint16_t *sat = buildChangeSums(pixmap, width);
+  if (sat == NULL)
+    print_verbose(verbose, "\tSummed-area table unavailable: full build");
+  fillQuadTree_aux(qt, pixmap, sat, 0, 0, 0, 0, width);
+  largeFree(sat);
+
+  // the statistics only depend on the means, they are computed once the tree
+  // is built
+  if (!lossless) {
+    if (computeStatistics(qt, verbose) == -1)
+      return -1;
+  } else {
+    freeStatistics(qt);
+    print_verbose(verbose, "\tLossless mode: variances are not computed");
+  }
   print_verbose(verbose, "\x1b[1;32mQuadTree filled successfully!\n\x1b[0m");
+  return 0;
 }
 
 size_t totalNodes(unsigned char h) {
@@ -120,14 +303,29 @@ size_t totalNodes(unsigned char h) {
   return (size_t)(((size_t)1 << (2 * h + 2)) - 1) / 3;
 }
 
+size_t firstDescendant(size_t index, unsigned char depth) {
+  // 4^d * index skips the descendants of the nodes before it on its level,
+  // totalNodes(d - 1) skips the levels above
+  return ((size_t)1 << (2 * depth)) * index +
+         (depth == 0 ? 0 : totalNodes(depth - 1));
+}
+
 QuadTree *createQuadTree(size_t width, int verbose) {
   assert(width > 0);
   print_verbose(verbose, "\x1b[1;32mCreating the QuadTree...\x1b[0m");
+  unsigned char numLevels = log_2(width);
+  if (numLevels > QT_MAX_LEVELS ||
+      totalNodes(numLevels) > SIZE_MAX / sizeof(Node)) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: the image is too large\n");
+    return NULL;
+  }
   QuadTree *qt = (QuadTree *)malloc(sizeof(QuadTree));
   if (qt != NULL) {
-    qt->numLevels = log_2(width);
+    qt->numLevels = numLevels;
+    qt->sum = qt->sumSq = NULL;
+    qt->v = NULL;
     size_t numNodes = totalNodes(qt->numLevels);
-    qt->root = (Node *)malloc(sizeof(Node) * numNodes);
+    qt->root = (Node *)largeAlloc(sizeof(Node) * numNodes);
     if (qt->root == NULL) {
       free(qt);
       fprintf(stderr, "\x1b[1;31mError\x1b[0m: memory allocation failed\n");
@@ -138,8 +336,76 @@ QuadTree *createQuadTree(size_t width, int verbose) {
   return qt;
 }
 
+QuadTree *mergeQuadTrees(QuadTree *children[4], int verbose) {
+  unsigned char numLevels = children[0]->numLevels;
+  for (int q = 1; q < 4; q++)
+    if (children[q]->numLevels != numLevels) {
+      fprintf(stderr,
+              "\x1b[1;31mError\x1b[0m: the merged images differ in size\n");
+      return NULL;
+    }
+  QuadTree *qt = createQuadTree((size_t)1 << numLevels, verbose);
+  if (qt == NULL)
+    return NULL;
+  print_verbose(verbose, "\x1b[1;32mMerging the QuadTrees...\x1b[0m");
+
+  // the level d holds the levels d - 1 of the children one after the other,
+  // their last level is dropped
+  for (unsigned char level = 1; level <= numLevels; level++) {
+    size_t count = (size_t)1 << (2 * (level - 1));
+    for (int q = 0; q < 4; q++)
+      memcpy(&qt->root[LEVEL_START(level) + q * count],
+             &children[q]->root[LEVEL_START(level - 1)], count * sizeof(Node));
+  }
+  unsigned int sum = 0;
+  for (int q = 0; q < 4; q++)
+    sum += children[q]->root[0].m;
+  qt->root[0].m = (unsigned char)(sum / 4);
+  qt->root[0].e = sum % 4;
+  // the means and errors below the root do not change, but the uniformity
+  // does once the nodes of the last level become leaves
+  for (size_t index = LEVEL_START(numLevels);
+       index < LEVEL_START(numLevels + 1); index++) {
+    qt->root[index].u = 1;
+    qt->root[index].e = 0;
+  }
+  for (int level = numLevels - 1; level >= 0; level--)
+    for (size_t index = LEVEL_START(level); index < LEVEL_START(level + 1);
+         index++)
+      qt->root[index].u =
+          qt->root[index].e == 0 && isUniform(qt->root, 4 * index + 1);
+  print_verbose(verbose, "\x1b[1;32mQuadTrees merged successfully!\n\x1b[0m");
+  return qt;
+}
+
+void reconstructQuadTree(QuadTree *qt) {
+  // a level is set once its parents are, so a uniform node passes its
+  // intensity down to all its descendants
+  for (unsigned char level = 0; level < qt->numLevels; level++)
+    for (size_t index = LEVEL_START(level); index < LEVEL_START(level + 1);
+         index++) {
+      Node node = qt->root[index];
+      if (node.e != 0 || node.u != 1)
+        continue;
+      Node child = {node.m, 1, 0};
+      Node *first = &qt->root[4 * index + 1];
+      first[0] = first[1] = first[2] = first[3] = child;
+    }
+}
+
+uint64_t hashQuadTree(const QuadTree *qt) {
+  // FNV-1a over the leaves, the descendants of the uniform nodes are set
+  const Node *leaf = &qt->root[LEVEL_START(qt->numLevels)];
+  size_t count = (size_t)1 << (2 * qt->numLevels);
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < count; i++)
+    h = (h ^ leaf[i].m) * 0x100000001b3ULL;
+  return h;
+}
+
 void freeQuadTree(QuadTree *qt) {
-  free(qt->root);
+  freeStatistics(qt);
+  largeFree(qt->root);
   free(qt);
 }
 
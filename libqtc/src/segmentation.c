@@ -1,99 +1,135 @@
 /*===========================================
   Authors:     Ghiles Maloum - Lucas Benesby
   Created:     09/11/2024
-  Modified:    10/12/2024
+  Modified:    19/10/2026
   =========================================== */
 
 #include "segmentation.h"
-#include "decoder.h"
+#include "large_alloc.h"
 
 #include <assert.h>
 #include <stdio.h>
-#include <time.h>
+#include <string.h>
 
+/// @brief Blocks being listed.
+typedef struct {
+  Block *blocks;
+  size_t count;
+  size_t capacity;
+} BlockList;
 
-/// @brief Create a white square at index level
-/// @param qt The quadtree where we will create white squares
-/// @param index The node number where the white square will begin
-static void whiteSquare(QuadTree *qt, int index) {
-  Node *node = &qt->root[index];
-  // put white color for the squared*
-  node->m = 255;
-  node->e = 0;
-  node->u = 0;
-
-  // Stop if we are at the last level
-  if (index >= totalNodes(qt->numLevels - 1)) {
-    return;
+/// @brief Draw a white square with a black upper and left outline
+/// @param pixmap The pixmap to draw in
+/// @param width The width of the pixmap
+/// @param x The column of the top left pixel of the square
+/// @param y The row of the top left pixel of the square
+/// @param size The width of the square
+static void contouredWhiteSquare(unsigned char *pixmap, size_t width, size_t x,
+                                 size_t y, size_t size) {
+  unsigned char *row = pixmap + y * width + x;
+  // upper outline
+  memset(row, 0, size);
+  for (size_t i = 1; i < size; i++) {
+    row += width;
+    // left outline then the inside of the square
+    row[0] = 0;
+    memset(row + 1, 255, size - 1);
   }
-
-  // call the function for all sons
-  whiteSquare(qt, 4 * index + 1);
-  whiteSquare(qt, 4 * index + 2);
-  whiteSquare(qt, 4 * index + 3);
-  whiteSquare(qt, 4 * index + 4);
 }
 
-/// @brief make the upper black outline of the square
-/// @param qt The quadtree
-/// @param index The node number where the outline will begin
-static void upper_square_contour(QuadTree *qt, int index) {
-  Node *node = &qt->root[index];
+int drawSegmentationBlocks(Block *blocks, size_t count, size_t width,
+                           unsigned char **pixmap, int verbose) {
+  assert(blocks != NULL || count == 0);
 
-  // if leaf, set in black
-  if (index >= totalNodes(qt->numLevels - 1)) {
-    node->m = 0;
-    node->e = 0;
-    node->u = 0;
-    return;
+  print_verbose(verbose, "\x1b[1;32mBuilding the segmentation grid...\x1b[0m");
+  *pixmap = (unsigned char *)largeAlloc(width * width * sizeof(unsigned char));
+  if (*pixmap == NULL) {
+    return -1;
   }
-
-  // call the function for the sons that on the upper side
-  upper_square_contour(qt, 4 * index + 1);
-  upper_square_contour(qt, 4 * index + 2);
+  for (size_t i = 0; i < count; i++)
+    contouredWhiteSquare(*pixmap, width, blocks[i].x, blocks[i].y,
+                         blocks[i].size);
+  print_verbose(verbose,
+                "\x1b[1;32mSegmentation grid built successfully!\n\x1b[0m");
+  return 0;
 }
 
-/// @brief make the left black outline of the square
-/// @param qt The quadtree
-/// @param index The node number where the outline will begin
-static void left_square_contour(QuadTree *qt, int index) {
-  Node *node = &qt->root[index];
+int buildSegmentationPixMap(QuadTree *qt, unsigned char **pixmap,
+                            int verbose) {
+  assert(qt != NULL);
+  Block *blocks = NULL;
+  size_t count;
+  if (listSegmentationBlocks(qt, &blocks, &count) == -1)
+    return -1;
+  int status = drawSegmentationBlocks(blocks, count,
+                                      (size_t)1 << qt->numLevels, pixmap,
+                                      verbose);
+  free(blocks);
+  return status;
+}
 
-  // if leaf, set in black
-  if (index >= totalNodes(qt->numLevels - 1)) {
-    node->m = 0;
-    node->e = 0;
-    node->u = 0;
-    return;
+static int listSegmentationBlocks_aux(QuadTree *qt, BlockList *list, size_t x,
+                                      size_t y, size_t nodeSize,
+                                      size_t nodeIndex) {
+  Node *node = &qt->root[nodeIndex];
+  if (nodeSize == 1 || (node->e == 0 && node->u == 1)) {
+    if (list->count == list->capacity) {
+      size_t capacity = list->capacity == 0 ? 256 : 2 * list->capacity;
+      Block *blocks = realloc(list->blocks, capacity * sizeof(Block));
+      if (blocks == NULL)
+        return -1;
+      list->blocks = blocks;
+      list->capacity = capacity;
+    }
+    list->blocks[list->count++] = (Block){x, y, nodeSize, node->m};
+    return 0;
   }
-
-  // call the function for the sons that on the left side
-  left_square_contour(qt, 4 * index + 1);
-  left_square_contour(qt, 4 * index + 4);
+  size_t shift = nodeSize / 2;
+  size_t childIndex = 4 * nodeIndex + 1; // child order: TL, TR, BR, BL
+  if (listSegmentationBlocks_aux(qt, list, x, y, shift, childIndex) == -1 ||
+      listSegmentationBlocks_aux(qt, list, x + shift, y, shift,
+                                 childIndex + 1) == -1 ||
+      listSegmentationBlocks_aux(qt, list, x + shift, y + shift, shift,
+                                 childIndex + 2) == -1 ||
+      listSegmentationBlocks_aux(qt, list, x, y + shift, shift,
+                                 childIndex + 3) == -1)
+    return -1;
+  return 0;
 }
 
-/// @brief Create the outline up left of the square
-/// @param qt The quadtree where we will create the outline
-/// @param index The node number where the outline will begin
-static void contour_square(QuadTree *qt, int index) {
-  // call the function for the upper and left side
-  // note: all that matters is that you contour a corner
-  // so right up , down right, down left are also correct
-  upper_square_contour(qt, index);
-  left_square_contour(qt, index);
+int listSegmentationBlocks(QuadTree *qt, Block **blocks, size_t *count) {
+  assert(qt != NULL);
+  BlockList list = {NULL, 0, 0};
+  size_t width = (size_t)1 << qt->numLevels;
+  if (listSegmentationBlocks_aux(qt, &list, 0, 0, width, 0) == -1) {
+    free(list.blocks);
+    return -1;
+  }
+  *blocks = list.blocks;
+  *count = list.count;
+  return 0;
 }
 
-/// @brief Make the square white with outline if node is uniform
-/// @param qt The quadtree where we will create the square
-void make_contoured_white_squares(QuadTree *qt) {
-  assert(qt != NULL);
+int writeSegmentationBlocks(const char *filename, Block *blocks, size_t count,
+                            size_t width, int verbose) {
+  assert(filename != NULL);
+  assert(blocks != NULL || count == 0);
 
-  for (size_t index = 0; index < totalNodes(qt->numLevels); index++) {
-    Node *node = &qt->root[index];
-    // if uniform node, create white square with outline
-    if (node->e == 0 && node->u == 1) {
-      whiteSquare(qt, index);
-      contour_square(qt, index);
-    }
+  char message[100];
+  sprintf(message,
+          "\x1b[1;32mWriting the segmentation blocks to\x1b[0m "
+          "\x1b[1;35m%s\x1b[0m",
+          filename);
+  print_verbose(verbose, message);
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) {
+    return -1;
   }
-}
\ No newline at end of file
+  fprintf(file, "%zu %zu\n", width, count);
+  for (size_t i = 0; i < count; i++)
+    fprintf(file, "%zu %zu %zu %u\n", blocks[i].x, blocks[i].y, blocks[i].size,
+            blocks[i].m);
+  fclose(file);
+  print_verbose(verbose, "\x1b[1;32mWriting successful!\x1b[0m");
+  return 0;
+}
@@ -0,0 +1,351 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#include "sparse_quadtree.h"
+#include "large_alloc.h"
+#include "parallel.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+// below this number of rows per band, threads cost more than they save
+#define MIN_BAND_ROWS 256
+
+#define WORD_BITS 64
+
+SparseQuadTree *createSparseQuadTree(unsigned char numLevels) {
+  SparseQuadTree *sqt = (SparseQuadTree *)malloc(sizeof(SparseQuadTree));
+  if (sqt == NULL)
+    return NULL;
+  sqt->numLevels = numLevels;
+  sqt->maxLevels = numLevels;
+  sqt->reused = 0;
+  sqt->levels = (SparseLevel *)calloc(numLevels + 1, sizeof(SparseLevel));
+  if (sqt->levels == NULL) {
+    free(sqt);
+    return NULL;
+  }
+  return sqt;
+}
+
+int resetSparseQuadTree(SparseQuadTree *sqt, unsigned char numLevels) {
+  assert(sqt != NULL);
+  if (numLevels > sqt->maxLevels) {
+    SparseLevel *levels =
+        realloc(sqt->levels, (numLevels + 1) * sizeof(SparseLevel));
+    if (levels == NULL)
+      return -1;
+    memset(levels + sqt->maxLevels + 1, 0,
+           (numLevels - sqt->maxLevels) * sizeof(SparseLevel));
+    sqt->levels = levels;
+    sqt->maxLevels = numLevels;
+  }
+  for (unsigned char level = 0; level <= sqt->maxLevels; level++)
+    sqt->levels[level].count = 0;
+  sqt->numLevels = numLevels;
+  sqt->reused = 1;
+  return 0;
+}
+
+int appendSparseNode(SparseQuadTree *sqt, unsigned char level, Node node) {
+  assert(sqt != NULL);
+  assert(level <= sqt->numLevels);
+  SparseLevel *l = &sqt->levels[level];
+  if (l->count == l->capacity) {
+    size_t capacity = l->capacity == 0 ? 64 : 2 * l->capacity;
+    Node *nodes = realloc(l->nodes, capacity * sizeof(Node));
+    if (nodes == NULL)
+      return -1;
+    l->nodes = nodes;
+    l->capacity = capacity;
+  }
+  l->nodes[l->count++] = node;
+  return 0;
+}
+
+int appendSparseGroup(SparseQuadTree *sqt, unsigned char level,
+                      const Node group[4]) {
+  assert(sqt != NULL);
+  assert(level > 0 && level <= sqt->numLevels);
+  SparseLevel *l = &sqt->levels[level];
+  if (l->count + 4 > l->capacity) {
+    size_t capacity = l->capacity == 0 ? 64 : 2 * l->capacity;
+    Node *nodes = realloc(l->nodes, capacity * sizeof(Node));
+    if (nodes == NULL)
+      return -1;
+    l->nodes = nodes;
+    l->capacity = capacity;
+  }
+  // the four siblings are copied at once
+  memcpy(&l->nodes[l->count], group, 4 * sizeof(Node));
+  l->count += 4;
+  return 0;
+}
+
+int finalizeSparseQuadTree(SparseQuadTree *sqt) {
+  assert(sqt != NULL);
+  // the leaves are never expanded, no bitmap is needed for them
+  for (unsigned char level = 0; level < sqt->numLevels; level++) {
+    SparseLevel *l = &sqt->levels[level];
+    size_t numWords = (l->count + WORD_BITS - 1) / WORD_BITS;
+    if (numWords + 1 > l->words) {
+      free(l->expanded);
+      free(l->rank);
+      l->words = 0;
+      l->expanded = (uint64_t *)malloc((numWords + 1) * sizeof(uint64_t));
+      l->rank = (size_t *)malloc((numWords + 1) * sizeof(size_t));
+      if (l->expanded == NULL || l->rank == NULL)
+        return -1;
+      l->words = numWords + 1;
+    }
+    memset(l->expanded, 0, (numWords + 1) * sizeof(uint64_t));
+    for (size_t i = 0; i < l->count; i++)
+      if (!(l->nodes[i].e == 0 && l->nodes[i].u == 1))
+        l->expanded[i / WORD_BITS] |= (uint64_t)1 << (i % WORD_BITS);
+    size_t rank = 0;
+    for (size_t w = 0; w <= numWords; w++) {
+      l->rank[w] = rank;
+      rank += __builtin_popcountll(l->expanded[w]);
+    }
+    // give back the unused capacity, unless the tree is read again
+    if (!sqt->reused && l->count != 0 && l->count < l->capacity) {
+      Node *nodes = realloc(l->nodes, l->count * sizeof(Node));
+      if (nodes != NULL) {
+        l->nodes = nodes;
+        l->capacity = l->count;
+      }
+    }
+  }
+  return 0;
+}
+
+size_t sparseFirstChild(SparseQuadTree *sqt, unsigned char level, size_t pos) {
+  SparseLevel *l = &sqt->levels[level];
+  uint64_t below = ((uint64_t)1 << (pos % WORD_BITS)) - 1;
+  // rank of the node among the expanded nodes of its level
+  size_t rank = l->rank[pos / WORD_BITS] +
+                __builtin_popcountll(l->expanded[pos / WORD_BITS] & below);
+  return 4 * rank;
+}
+
+size_t sparseNodeCount(SparseQuadTree *sqt) {
+  size_t count = 0;
+  for (unsigned char level = 0; level <= sqt->numLevels; level++)
+    count += sqt->levels[level].count;
+  return count;
+}
+
+/// @brief Draws the rows [firstRow, lastRow) of the region of a node.
+static void drawSparseQuadTree_aux(SparseQuadTree *sqt, unsigned char *buffer,
+                                   size_t stride, size_t firstRow,
+                                   size_t lastRow, size_t x, size_t y,
+                                   unsigned char level, size_t pos) {
+  size_t nodeSize = (size_t)1 << (sqt->numLevels - level);
+  if (y >= lastRow || y + nodeSize <= firstRow)
+    return;
+  Node *node = &sqt->levels[level].nodes[pos];
+  if (level == sqt->numLevels || (node->e == 0 && node->u == 1)) {
+    // fill the region of the uniform node row by row
+    size_t first = y < firstRow ? firstRow : y;
+    size_t last = y + nodeSize > lastRow ? lastRow : y + nodeSize;
+    for (size_t i = first; i < last; i++)
+      memset(buffer + i * stride + x, node->m, nodeSize);
+    return;
+  }
+  size_t shift = nodeSize / 2;
+  size_t child = sparseFirstChild(sqt, level, pos); // order: TL, TR, BR, BL
+  drawSparseQuadTree_aux(sqt, buffer, stride, firstRow, lastRow, x, y,
+                         level + 1, child);
+  drawSparseQuadTree_aux(sqt, buffer, stride, firstRow, lastRow, x + shift, y,
+                         level + 1, child + 1);
+  drawSparseQuadTree_aux(sqt, buffer, stride, firstRow, lastRow, x + shift,
+                         y + shift, level + 1, child + 2);
+  drawSparseQuadTree_aux(sqt, buffer, stride, firstRow, lastRow, x, y + shift,
+                         level + 1, child + 3);
+}
+
+void drawSparseQuadTree(SparseQuadTree *sqt, unsigned char *buffer,
+                        size_t stride) {
+  assert(sqt != NULL);
+  assert(buffer != NULL);
+  size_t width = (size_t)1 << sqt->numLevels;
+  drawSparseQuadTree_aux(sqt, buffer, stride, 0, width, 0, 0, 0, 0);
+}
+
+/// @brief Band of rows drawn by a thread
+typedef struct {
+  SparseQuadTree *sqt;   // tree to draw
+  unsigned char *buffer; // image to draw into
+  size_t stride;         // bytes from a row to the next
+  size_t firstRow;       // first row of the band
+  size_t lastRow;        // row after the band
+} BandJob;
+
+/// @brief Draws the rows of a band.
+/// @param arg The job
+/// @return NULL
+static void *drawBand(void *arg) {
+  BandJob *job = (BandJob *)arg;
+  drawSparseQuadTree_aux(job->sqt, job->buffer, job->stride, job->firstRow,
+                         job->lastRow, 0, 0, 0, 0);
+  return NULL;
+}
+
+void drawSparseRowsParallel(SparseQuadTree *sqt, unsigned char *buffer,
+                            size_t stride, size_t firstRow, size_t lastRow) {
+  assert(sqt != NULL);
+  assert(buffer != NULL);
+  assert(firstRow <= lastRow && lastRow <= (size_t)1 << sqt->numLevels);
+  size_t rows = lastRow - firstRow;
+  size_t numThreads = parallelThreads(rows / MIN_BAND_ROWS);
+
+  // the bands do not overlap, so the threads never write the same byte
+  BandJob jobs[numThreads];
+  for (size_t t = 0; t < numThreads; t++)
+    jobs[t] = (BandJob){sqt, buffer, stride, firstRow + t * rows / numThreads,
+                        firstRow + (t + 1) * rows / numThreads};
+  runParallel(drawBand, jobs, sizeof(BandJob), numThreads);
+}
+
+void drawSparseQuadTreeParallel(SparseQuadTree *sqt, unsigned char *buffer,
+                                size_t stride) {
+  assert(sqt != NULL);
+  drawSparseRowsParallel(sqt, buffer, stride, 0,
+                         (size_t)1 << sqt->numLevels);
+}
+
+int buildPixMapSparse(SparseQuadTree *sqt, unsigned char **pixmap,
+                      int verbose) {
+  assert(sqt != NULL);
+  size_t width = (size_t)1 << sqt->numLevels;
+
+  print_verbose(verbose, "\x1b[1;32mBuilding the pixmap...\x1b[0m");
+  *pixmap = (unsigned char *)largeAlloc(width * width * sizeof(unsigned char));
+  if (*pixmap == NULL) {
+    return -1;
+  }
+  drawSparseQuadTreeParallel(sqt, *pixmap, width);
+  print_verbose(verbose, "\x1b[1;32mPixmap built successfully!\n\x1b[0m");
+  return 0;
+}
+
+static int listSparseBlocks_aux(SparseQuadTree *sqt, Block **blocks,
+                                size_t *count, size_t *capacity, size_t x,
+                                size_t y, unsigned char level, size_t pos) {
+  Node *node = &sqt->levels[level].nodes[pos];
+  size_t nodeSize = (size_t)1 << (sqt->numLevels - level);
+  if (level == sqt->numLevels || (node->e == 0 && node->u == 1)) {
+    if (*count == *capacity) {
+      size_t newCapacity = *capacity == 0 ? 256 : 2 * *capacity;
+      Block *newBlocks = realloc(*blocks, newCapacity * sizeof(Block));
+      if (newBlocks == NULL)
+        return -1;
+      *blocks = newBlocks;
+      *capacity = newCapacity;
+    }
+    (*blocks)[(*count)++] = (Block){x, y, nodeSize, node->m};
+    return 0;
+  }
+  size_t shift = nodeSize / 2;
+  size_t child = sparseFirstChild(sqt, level, pos);
+  if (listSparseBlocks_aux(sqt, blocks, count, capacity, x, y, level + 1,
+                           child) == -1 ||
+      listSparseBlocks_aux(sqt, blocks, count, capacity, x + shift, y,
+                           level + 1, child + 1) == -1 ||
+      listSparseBlocks_aux(sqt, blocks, count, capacity, x + shift, y + shift,
+                           level + 1, child + 2) == -1 ||
+      listSparseBlocks_aux(sqt, blocks, count, capacity, x, y + shift,
+                           level + 1, child + 3) == -1)
+    return -1;
+  return 0;
+}
+
+int listSparseBlocks(SparseQuadTree *sqt, Block **blocks, size_t *count) {
+  assert(sqt != NULL);
+  size_t capacity = 0;
+  *blocks = NULL;
+  *count = 0;
+  if (listSparseBlocks_aux(sqt, blocks, count, &capacity, 0, 0, 0, 0) == -1) {
+    free(*blocks);
+    *blocks = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+/// @brief Adds up the pixels of the region [x0, x1) x [y0, y1) covered by
+/// the region of a node.
+static uint64_t sparseRegionSum_aux(SparseQuadTree *sqt, size_t x0, size_t y0,
+                                    size_t x1, size_t y1, size_t x, size_t y,
+                                    unsigned char level, size_t pos) {
+  size_t nodeSize = (size_t)1 << (sqt->numLevels - level);
+  if (x >= x1 || y >= y1 || x + nodeSize <= x0 || y + nodeSize <= y0)
+    return 0;
+  Node *node = &sqt->levels[level].nodes[pos];
+  if (level == sqt->numLevels || (node->e == 0 && node->u == 1)) {
+    // a block adds its value times the area it shares with the region
+    size_t w = (x + nodeSize < x1 ? x + nodeSize : x1) - (x > x0 ? x : x0);
+    size_t h = (y + nodeSize < y1 ? y + nodeSize : y1) - (y > y0 ? y : y0);
+    return (uint64_t)node->m * w * h;
+  }
+  size_t shift = nodeSize / 2;
+  size_t child = sparseFirstChild(sqt, level, pos);
+  return sparseRegionSum_aux(sqt, x0, y0, x1, y1, x, y, level + 1, child) +
+         sparseRegionSum_aux(sqt, x0, y0, x1, y1, x + shift, y, level + 1,
+                             child + 1) +
+         sparseRegionSum_aux(sqt, x0, y0, x1, y1, x + shift, y + shift,
+                             level + 1, child + 2) +
+         sparseRegionSum_aux(sqt, x0, y0, x1, y1, x, y + shift, level + 1,
+                             child + 3);
+}
+
+uint64_t sparseRegionSum(SparseQuadTree *sqt, size_t x, size_t y, size_t w,
+                         size_t h) {
+  assert(sqt != NULL);
+  return sparseRegionSum_aux(sqt, x, y, x + w, y + h, 0, 0, 0, 0);
+}
+
+void sparseHistogram(SparseQuadTree *sqt, size_t histogram[256]) {
+  assert(sqt != NULL);
+  memset(histogram, 0, 256 * sizeof(size_t));
+  // the blocks do not depend on their position, the levels are scanned
+  for (unsigned char level = 0; level <= sqt->numLevels; level++) {
+    SparseLevel *l = &sqt->levels[level];
+    size_t area = (size_t)1 << (2 * (sqt->numLevels - level));
+    for (size_t i = 0; i < l->count; i++)
+      if (level == sqt->numLevels || (l->nodes[i].e == 0 && l->nodes[i].u == 1))
+        histogram[l->nodes[i].m] += area;
+  }
+}
+
+void sparseMinMax(SparseQuadTree *sqt, unsigned char *min,
+                  unsigned char *max) {
+  assert(sqt != NULL);
+  unsigned char lo = 255, hi = 0;
+  for (unsigned char level = 0; level <= sqt->numLevels; level++) {
+    SparseLevel *l = &sqt->levels[level];
+    for (size_t i = 0; i < l->count; i++) {
+      Node *node = &l->nodes[i];
+      if (level == sqt->numLevels || (node->e == 0 && node->u == 1)) {
+        lo = node->m < lo ? node->m : lo;
+        hi = node->m > hi ? node->m : hi;
+      }
+    }
+  }
+  *min = lo;
+  *max = hi;
+}
+
+void freeSparseQuadTree(SparseQuadTree *sqt) {
+  for (unsigned char level = 0; level <= sqt->maxLevels; level++) {
+    free(sqt->levels[level].nodes);
+    free(sqt->levels[level].expanded);
+    free(sqt->levels[level].rank);
+  }
+  free(sqt->levels);
+  free(sqt);
+}
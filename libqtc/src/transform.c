@@ -0,0 +1,75 @@
+/*===========================================
+  Authors:     Ghiles Maloum - Lucas Benesby
+  Created:     19/10/2026
+  Modified:    --/--/----
+  =========================================== */
+
+#include "transform.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+// child of the source tree moved to each position (TL, TR, BR, BL) of the
+// transformed tree, for the flips and rotations
+static const unsigned char permutations[5][4] = {
+    {1, 0, 3, 2}, // TRANSFORM_FLIP_H
+    {3, 2, 1, 0}, // TRANSFORM_FLIP_V
+    {3, 0, 1, 2}, // TRANSFORM_ROT90
+    {2, 3, 0, 1}, // TRANSFORM_ROT180
+    {1, 2, 3, 0}, // TRANSFORM_ROT270
+};
+
+// a crop keeps the children in place
+static const unsigned char identity[4] = {0, 1, 2, 3};
+
+/// @brief Copies the subtree of a node, its children reordered at every
+/// level. The mean of a node is the mean of the same children, its error is
+/// the remainder of their sum and its uniformity does not depend on their
+/// order, so every node is copied as is. The encoder then infers the fourth
+/// child from the new order.
+/// @param src The nodes of the source tree.
+/// @param dst The nodes of the transformed tree.
+/// @param srcIndex The index of the node in the source tree.
+/// @param dstIndex The index of the node in the transformed tree.
+/// @param height The number of levels below the node.
+/// @param order The source child moved to each position.
+static void transformSubtree(const Node *src, Node *dst, size_t srcIndex,
+                             size_t dstIndex, unsigned char height,
+                             const unsigned char order[4]) {
+  dst[dstIndex] = src[srcIndex];
+  if (height == 0)
+    return;
+  for (size_t i = 0; i < 4; i++)
+    transformSubtree(src, dst, 4 * srcIndex + 1 + order[i],
+                     4 * dstIndex + 1 + i, height - 1, order);
+}
+
+QuadTree *transformQuadTree(QuadTree *qt, int op, int verbose) {
+  assert(qt != NULL);
+  int crop = op >= TRANSFORM_CROP_TL;
+  if (op < TRANSFORM_FLIP_H || op > TRANSFORM_CROP_BL) {
+    fprintf(stderr, "\x1b[1;31mError\x1b[0m: unknown transform %d\n", op);
+    return NULL;
+  }
+  if (crop && qt->numLevels == 0) {
+    fprintf(stderr,
+            "\x1b[1;31mError\x1b[0m: a 1x1 image has no quadrant to crop\n");
+    return NULL;
+  }
+
+  // a quadrant is the subtree of a child of the root, one level shorter
+  unsigned char numLevels = crop ? qt->numLevels - 1 : qt->numLevels;
+  QuadTree *result = createQuadTree((size_t)1 << numLevels, verbose);
+  if (result == NULL)
+    return NULL;
+  print_verbose(verbose, "\x1b[1;32mTransforming the QuadTree...\x1b[0m");
+  if (crop)
+    transformSubtree(qt->root, result->root, 1 + op - TRANSFORM_CROP_TL, 0,
+                     numLevels, identity);
+  else
+    transformSubtree(qt->root, result->root, 0, 0, numLevels,
+                     permutations[op]);
+  print_verbose(verbose,
+                "\x1b[1;32mQuadTree transformed successfully!\n\x1b[0m");
+  return result;
+}